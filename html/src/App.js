@@ -19,7 +19,7 @@ function App() {
   // On component mount, get the initial colors.
   useEffect(() => {
     if(data === null) {
-      let url = 'http://api.kevr.tk:8000/colors';
+      let url = '/colors';
       const options = {
         method: 'GET',
         credentials: 'same-origin'
@@ -45,7 +45,7 @@ function App() {
     const color = e.hex.replace('#', '');
 
     console.log(`Region: ${region}`);
-    let url = `http://api.kevr.tk:8000/colors/${region}?color=${color}`;
+    let url = `/colors/${region}?color=${color}`;
     const options = {
       method: 'PUT',
       credentials: 'same-origin',
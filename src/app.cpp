@@ -0,0 +1,243 @@
+#include "app.hpp"
+#include "fade.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <sys/stat.h>
+
+static app::response fail(app::response res, int rc, const char *error)
+{
+    res.status = rc;
+    strncpy(res.error, error, sizeof(res.error) - 1);
+    return res;
+}
+
+static bool ensure_dir(const char *path)
+{
+    if (fs::exists(path))
+        return true;
+
+    int rc = mkdir(path, 0777);
+    return rc != -1 || errno == EEXIST;
+}
+
+bool app::ensure_cache_dir(void)
+{
+    return ensure_dir(CACHE_PREFIX);
+}
+
+bool app::ensure_data_dir(void)
+{
+    return ensure_dir(DATA_PREFIX);
+}
+
+// The colors to cache, preferring values already known or cached over
+// reading regions back from sysfs.
+static std::array<color::rgb, 4> cached_colors(app::state &st)
+{
+    auto known = st.kb.known();
+    auto cached = st.cache.color.data();
+
+    std::array<color::rgb, 4> colors;
+    for (std::size_t i = 0; i < colors.size(); ++i) {
+        if (known[i])
+            colors[i] = *known[i];
+        else if (cached)
+            colors[i] = (*cached)[i];
+        else
+            return st.kb.regions();
+    }
+    return colors;
+}
+
+void app::submit(app::state &st)
+{
+    try {
+        st.batch.submit();
+    } catch (...) {
+        st.kb.forget();
+        st.brightness.reload();
+        throw;
+    }
+}
+
+// Boot-time restore: straight from the state file to the attributes,
+// without reading anything from sysfs first.
+static app::response restore(app::state &st)
+{
+    app::response res;
+    auto &cache = st.cache;
+    if (!cache.color.exists())
+        return fail(res, 1, "cannot restore without a color cache.");
+    if (!cache.brightness.exists())
+        return fail(res, 2, "cannot restore without a brightness cache.");
+
+    st.kb.stage(cache.color.data().value());
+    st.brightness.stage_trusted(cache.brightness.data().value());
+    logging::debug("Restoring brightness:", st.brightness.pending_level(),
+                   '.');
+
+    auto stats = st.kb.force_commit(st.batch);
+    stats += st.brightness.force_commit(st.batch);
+    submit(st);
+    res.written = stats.written;
+    return res;
+}
+
+app::response app::run(state &st, const request &req)
+{
+    response res;
+    auto &cache = st.cache;
+    auto &kb = st.kb;
+    auto &brightness = st.brightness;
+
+    if (req.version != protocol_version)
+        return fail(res, 1, "protocol version mismatch.");
+
+    // A brightness change during a fade carries on from the fade's
+    // target, and either retargets it or, without a fade of its own,
+    // ends it.
+    const bool sets_level =
+        req.has(request::restore) || req.has(request::brightness) ||
+        req.has(request::increment) || req.has(request::toggle);
+    if (st.fader && st.fader->active() && sets_level) {
+        brightness.stage_trusted(st.fader->target());
+        if (!req.fade_ms)
+            st.fader->cancel();
+    }
+
+    if (req.flags == (request::restore | request::quiet) && !req.fade_ms)
+        return restore(st);
+
+    // Brightness is only read from sysfs when it is being changed or
+    // reported back.
+    const bool quiet = req.has(request::quiet);
+    const bool uses_level =
+        !quiet || req.has(request::restore) ||
+        req.has(request::brightness) || req.has(request::increment) ||
+        req.has(request::toggle);
+
+    // Validate everything up front so a bad request never leaves
+    // anything staged behind in a long-lived state.
+    std::optional<color::rgb> colors[4];
+    const request::flag region_flags[] = {request::left, request::center,
+                                          request::right, request::extra};
+    for (std::size_t i = 0; i < 4; ++i) {
+        if (!req.has(region_flags[i]))
+            continue;
+        auto value = color::hex::decode(
+            std::string_view(req.colors[i], sizeof(req.colors[i])));
+        if (!value)
+            return fail(res, 1, "invalid color in request.");
+        colors[i] = color::rgb(*value);
+    }
+
+    std::array<color::rgb, 4> restored;
+    if (req.has(request::restore)) {
+        if (!cache.color.exists())
+            return fail(res, 1, "cannot restore without a color cache.");
+        restored = cache.color.data().value();
+
+        if (!cache.brightness.exists())
+            return fail(res, 2, "cannot restore without a brightness cache.");
+    }
+
+    // Everything below is staged first and committed in one pass at the
+    // end, so each attribute and cache is written at most once.
+    if (req.has(request::restore)) {
+        kb.stage(restored);
+        brightness.stage_value(cache.brightness.data().value());
+        logging::debug("Restoring brightness:", brightness.pending_level(),
+                       '.');
+    }
+
+    // -l, -c, -r and -e address the layout's first four zones.
+    for (std::size_t i = 0; i < 4 && i < kb.size(); ++i) {
+        if (colors[i])
+            kb.stage(i, *colors[i]);
+    }
+
+    // The brightness cache value we'll end up with.
+    auto cached_level = cache.brightness.data();
+
+    if (uses_level && !cache.hw_brightness.exists()) {
+        cache.hw_brightness.set_data(brightness.hw_level());
+        cached_level = brightness.level();
+    } else if (uses_level) {
+        if (brightness.hw_level() &&
+            brightness.hw_level() != cache.hw_brightness.data().value()) {
+            cache.hw_brightness.set_data(brightness.hw_level());
+        }
+    }
+
+    if (req.has(request::brightness))
+        brightness.stage_value(req.level);
+
+    // If -i was given, apply the increment to brightness.
+    if (req.has(request::increment))
+        brightness.stage_increment(req.delta);
+
+    // If brightness level is > 0 and it mismatches the cache, update it.
+    if (uses_level && brightness.pending_level() > 0)
+        cached_level = brightness.pending_level();
+
+    if (req.has(request::toggle))
+        brightness.stage_value(brightness.pending_level()
+                                   ? 0
+                                   : cached_level.value_or(
+                                         brightness.max_level()));
+
+    // Without a fade, colors and brightness go out as one batch.
+    auto stats = kb.commit(st.batch);
+    if (!req.fade_ms)
+        stats += brightness.commit(st.batch);
+    submit(st);
+    if (st.fader)
+        stats += st.fader->start(
+            brightness,
+            std::chrono::milliseconds(std::min(req.fade_ms, max_fade_ms)));
+    else
+        stats += led::fade(brightness,
+                           std::chrono::milliseconds(req.fade_ms));
+
+    if (cached_level && cached_level != cache.brightness.data())
+        cache.brightness.set_data(cached_level.value());
+
+    // Store the color cache; unchanged values don't dirty the state.
+    cache.color.set_data(cached_colors(st));
+
+    res.written = stats.written;
+    res.skipped = stats.skipped;
+    if (quiet)
+        return res;
+
+    auto current = kb.regions();
+    for (std::size_t i = 0; i < current.size(); ++i)
+        color::hex::encode(res.colors[i], current[i].value());
+
+    res.level = st.fader && st.fader->active() ? st.fader->target()
+                                                : brightness.level();
+    res.max_level = brightness.max_level();
+    res.hw_level = brightness.hw_level();
+    return res;
+}
+
+void app::on_hw_changed(state &st, uint32_t hw_level)
+{
+    // The Fn keys win over a fade in progress.
+    if (st.fader)
+        st.fader->cancel();
+    st.brightness.reload();
+
+    if (!st.cache.hw_brightness.exists() ||
+        st.cache.hw_brightness.data().value() != hw_level)
+        st.cache.hw_brightness.set_data(hw_level);
+
+    auto level = st.brightness.level();
+    if (level > 0 && st.cache.brightness.data() != level)
+        st.cache.brightness.set_data(level);
+
+    logging::debug("Hardware brightness changed:", level, '.');
+}
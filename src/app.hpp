@@ -0,0 +1,177 @@
+#ifndef APP_HPP
+#define APP_HPP
+
+#include "brightness.hpp"
+#include "device.hpp"
+#include "fade.hpp"
+#include "keyboard.hpp"
+#include "profiles.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace app
+{
+
+// Version of the request/response layout below; bumped whenever either
+// struct changes so a stale client and daemon refuse each other.
+constexpr uint16_t protocol_version = 3;
+
+// Longest fade a server will run; a request asking for more gets this.
+constexpr uint32_t max_fade_ms = 10000;
+
+/**
+ * @brief A single invocation of the program, independent of where it runs.
+ *
+ * This is a fixed-size POD so that it can be sent over the daemon's
+ * socket as-is; colors are carried as the raw 6-character hex strings
+ * given on the command line.
+ **/
+struct request {
+    enum flag : uint32_t {
+        toggle = 1 << 0,
+        restore = 1 << 1,
+        left = 1 << 2,
+        center = 1 << 3,
+        right = 1 << 4,
+        extra = 1 << 5,
+        brightness = 1 << 6,
+        increment = 1 << 7,
+
+        // The caller doesn't use the resulting state; don't read sysfs
+        // just to report it.
+        quiet = 1 << 8,
+    };
+
+    uint16_t version = protocol_version;
+    uint16_t reserved = 0;
+    uint32_t flags = 0;
+    char colors[4][6] = {};
+    int32_t level = 0;
+    int32_t delta = 0;
+
+    // Fade brightness changes over this many milliseconds; 0 snaps.
+    uint32_t fade_ms = 0;
+
+    bool has(flag f) const
+    {
+        return flags & f;
+    }
+};
+
+/**
+ * @brief The outcome of running a request.
+ *
+ * A non-zero status is the exit code the program should return, with
+ * error holding the message that should be printed.
+ **/
+struct response {
+    int32_t status = 0;
+    char colors[4][6] = {};
+    uint32_t level = 0;
+    uint32_t max_level = 0;
+    uint32_t hw_level = 0;
+
+    // Attribute writes performed and skipped as redundant.
+    uint32_t written = 0;
+    uint32_t skipped = 0;
+
+    char error[128] = {};
+};
+
+struct cache {
+    fs::state_file file;
+    fs::brightness_cache<uint32_t> brightness{file};
+    fs::hw_brightness_cache<uint32_t> hw_brightness{file};
+    fs::color_cache color{file};
+
+    cache(void) = default;
+
+    explicit cache(std::string path)
+        : file(std::move(path))
+    {
+    }
+};
+
+/**
+ * @brief Everything a request operates on.
+ *
+ * A one-shot invocation constructs this once and throws it away; the
+ * daemon keeps a single instance alive for its whole lifetime.
+ **/
+struct state {
+    app::cache cache;
+    color::keyboard kb;
+    led::brightness<uint32_t> brightness;
+
+    // Commits of a request go out together through this.
+    fs::batch batch;
+
+    // Set by long-lived owners that poll its fd(): brightness fades are
+    // then stepped from their loop instead of blocking run().
+    std::optional<led::fader<uint32_t>> fader;
+
+    // The four-zone device at SYSFS_PREFIX, with the default caches.
+    state(void) = default;
+
+    // dev, with the layout its attributes suggest.
+    explicit state(const led::device &dev)
+        : state(dev, color::detect_layout(dev.path))
+    {
+    }
+
+    state(const led::device &dev, const color::layout &layout)
+        : cache(dev.cache)
+        , kb(dev.path, layout)
+        , brightness(dev.path)
+    {
+    }
+};
+
+/**
+ * @brief Make sure CACHE_PREFIX exists.
+ *
+ * @returns Boolean indicating whether the cache directory is usable.
+ **/
+bool ensure_cache_dir(void);
+
+/**
+ * @brief Make sure DATA_PREFIX, where profiles live, exists.
+ **/
+bool ensure_data_dir(void);
+
+/**
+ * @brief Perform the writes queued on st.batch.
+ *
+ * Values assumed written are dropped on failure so a long-lived state
+ * reads them back.
+ *
+ * @throws std::system_error if the batch couldn't be submitted.
+ **/
+void submit(state &st);
+
+/**
+ * @brief Apply req to st, updating hardware and caches.
+ *
+ * @param st State to operate on.
+ * @param req Request to apply.
+ * @returns A response describing the resulting keyboard state; with
+ *          request::quiet, only the status and write counts are set.
+ **/
+response run(state &st, const request &req);
+
+/**
+ * @brief Bring st in line with a level set by the firmware.
+ *
+ * Called when brightness_hw_changed reports a new level; refreshes the
+ * in-memory brightness and updates the brightness and hw_brightness
+ * caches the same way a regular run would.
+ *
+ * @param st State to update.
+ * @param hw_level New value of brightness_hw_changed.
+ **/
+void on_hw_changed(state &st, uint32_t hw_level);
+
+}; // namespace app
+
+#endif /* APP_HPP */
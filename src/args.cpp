@@ -0,0 +1,266 @@
+#include "args.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+using namespace args;
+
+// Parse all of text as a T; a leading '+' is accepted for numbers.
+template <typename T>
+static bool convert(std::string_view text, T &out)
+{
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+    if (text.empty() || text.front() == '+')
+        return false;
+
+    auto end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, out);
+    return ec == std::errc() && ptr == end;
+}
+
+static bool convert(std::string_view text, double &out)
+{
+    return to_real(text, out);
+}
+
+bool args::to_real(std::string_view text, double &out)
+{
+    char buf[64];
+    if (text.empty() || text.size() >= sizeof(buf) || isspace(text[0]))
+        return false;
+    memcpy(buf, text.data(), text.size());
+    buf[text.size()] = '\0';
+
+    // strtod() also takes "nan" and "inf", which nothing here wants.
+    char *end;
+    errno = 0;
+    out = strtod(buf, &end);
+    return !errno && end == buf + text.size() && std::isfinite(out);
+}
+
+static bool valid(kind type, std::string_view text)
+{
+    int i;
+    unsigned u;
+    double d;
+    switch (type) {
+    case kind::integer:
+        return convert(text, i);
+    case kind::unsigned_integer:
+        return convert(text, u);
+    case kind::real:
+        return convert(text, d);
+    default:
+        return true;
+    }
+}
+
+static std::string quoted(const option &o)
+{
+    return "'--" + std::string(o.name) + "'";
+}
+
+// Index of the long option called name, or the only one it prefixes.
+static std::size_t find_long(const option *options, std::size_t size,
+                             std::string_view name)
+{
+    std::size_t match = size;
+    std::string matches;
+    for (std::size_t i = 0; i < size; ++i) {
+        if (options[i].name == name)
+            return i;
+        if (options[i].name.substr(0, name.size()) != name)
+            continue;
+        if (!matches.empty())
+            matches += ", ";
+        matches += quoted(options[i]);
+        match = match == size ? i : size + 1;
+    }
+
+    if (match > size)
+        throw error("option '--" + std::string(name) +
+                    "' is ambiguous and matches " + matches);
+    return match;
+}
+
+static std::size_t find_short(const option *options, std::size_t size,
+                              char name)
+{
+    std::size_t i = 0;
+    while (i < size && options[i].short_name != name)
+        ++i;
+    return i;
+}
+
+template <>
+std::string value::as<std::string>(void) const
+{
+    return std::string(m_text);
+}
+
+template <>
+int value::as<int>(void) const
+{
+    int out = 0;
+    convert(m_text, out);
+    return out;
+}
+
+template <>
+unsigned value::as<unsigned>(void) const
+{
+    unsigned out = 0;
+    convert(m_text, out);
+    return out;
+}
+
+template <>
+double value::as<double>(void) const
+{
+    double out = 0.0;
+    convert(m_text, out);
+    return out;
+}
+
+void args::parse(const option *options, std::size_t size,
+                 std::string_view *values, bool *given, int argc,
+                 char *argv[])
+{
+    auto store = [&](std::size_t i, std::string_view text) {
+        const option &o = options[i];
+        if (given[i]) {
+            throw error("option " + quoted(o) +
+                        " cannot be specified more than once");
+        }
+        if (!valid(o.type, text)) {
+            throw error("the argument ('" + std::string(text) +
+                        "') for option " + quoted(o) + " is invalid");
+        }
+        given[i] = true;
+        values[i] = text;
+    };
+
+    // The argument of a value option that isn't attached to it.
+    auto next = [&](int &i, std::size_t opt) -> std::string_view {
+        if (i + 1 >= argc) {
+            throw error("the required argument for option " +
+                        quoted(options[opt]) + " is missing");
+        }
+        return argv[++i];
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg == "--")
+            break;
+
+        if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+            auto body = arg.substr(2);
+            auto eq = body.find('=');
+            auto opt = find_long(options, size, body.substr(0, eq));
+            if (opt == size)
+                continue;
+
+            if (options[opt].type == kind::flag) {
+                if (eq != std::string_view::npos) {
+                    throw error("option " + quoted(options[opt]) +
+                                " does not take any arguments");
+                }
+                store(opt, {});
+            } else if (eq != std::string_view::npos) {
+                store(opt, body.substr(eq + 1));
+            } else {
+                store(opt, next(i, opt));
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            // Bundled short options; the first one taking a value
+            // consumes the rest of the word, or the next word.
+            for (std::size_t j = 1; j < arg.size(); ++j) {
+                auto opt = find_short(options, size, arg[j]);
+                if (opt == size)
+                    break;
+
+                if (options[opt].type == kind::flag) {
+                    store(opt, {});
+                    continue;
+                }
+
+                auto rest = arg.substr(j + 1);
+                store(opt, rest.empty() ? next(i, opt) : rest);
+                break;
+            }
+        }
+    }
+}
+
+std::string args::help(const option *options, std::size_t size,
+                       std::string_view caption)
+{
+    constexpr std::size_t line_length = 80;
+
+    // Left column, e.g. "  -b [ --brightness ] arg (=0)".
+    auto left = [&](const option &o) {
+        std::string s = "  ";
+        if (o.short_name) {
+            s += '-';
+            s += o.short_name;
+            s += " [ --";
+            s.append(o.name);
+            s += " ]";
+        } else {
+            s += "--";
+            s.append(o.name);
+        }
+        if (o.type != kind::flag) {
+            s += " arg";
+            if (!o.fallback.empty()) {
+                s += " (=";
+                s.append(o.fallback);
+                s += ')';
+            }
+        }
+        return s;
+    };
+
+    std::size_t width = 0;
+    for (std::size_t i = 0; i < size; ++i)
+        width = std::max(width, left(options[i]).size());
+    width = std::min(width + 1, line_length / 2);
+
+    std::string out(caption);
+    out += ":\n";
+    for (std::size_t i = 0; i < size; ++i) {
+        auto s = left(options[i]);
+        if (s.size() >= width) {
+            out += s;
+            out += '\n';
+            s.clear();
+        }
+        s.resize(width, ' ');
+
+        // Wrap the description after the last space that fits, leaving
+        // the space at the end of the line.
+        auto text = options[i].help;
+        const std::size_t room = line_length - 1 - width;
+        while (text.size() > room) {
+            auto cut = text.substr(0, room).find_last_of(' ');
+            cut = cut == std::string_view::npos ? room : cut + 1;
+            out += s;
+            out.append(text.substr(0, cut));
+            out += '\n';
+            text.remove_prefix(cut);
+            while (!text.empty() && text.front() == ' ')
+                text.remove_prefix(1);
+            s.assign(width, ' ');
+        }
+        out += s;
+        out.append(text);
+        out += '\n';
+    }
+    return out;
+}
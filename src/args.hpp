@@ -0,0 +1,171 @@
+#ifndef ARGS_HPP
+#define ARGS_HPP
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace args
+{
+
+// What an option's argument is parsed as; flag options take none.
+enum class kind : unsigned char {
+    flag,
+    string,
+    integer,
+    unsigned_integer,
+    real,
+};
+
+/**
+ * @brief One command line option, described entirely at compile time.
+ *
+ * Tables of these are constexpr arrays, so describing the options costs
+ * nothing at startup; parsing only records where each value lives in
+ * argv.
+ **/
+struct option {
+    // Long name, used as --name and to look the option up.
+    std::string_view name;
+
+    // Single character used as -c, or '\0' for none.
+    char short_name;
+
+    kind type;
+    std::string_view help;
+
+    // Value used when the option isn't given; empty for none.
+    std::string_view fallback = {};
+};
+
+// Thrown on malformed command lines, with a message fit for the user.
+class error : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief The argument given to an option, converted on demand.
+ **/
+class value
+{
+private:
+    std::string_view m_text;
+
+public:
+    constexpr explicit value(std::string_view text)
+        : m_text(text)
+    {
+    }
+
+    /**
+     * @brief Convert the argument to T.
+     *
+     * Only std::string, int, unsigned and double are supported; the
+     * parser has already checked that the text converts.
+     **/
+    template <typename T>
+    T as(void) const;
+};
+
+template <>
+std::string value::as<std::string>(void) const;
+template <>
+int value::as<int>(void) const;
+template <>
+unsigned value::as<unsigned>(void) const;
+template <>
+double value::as<double>(void) const;
+
+/**
+ * @brief Parse argv against options.
+ *
+ * Accepts -c, -cVALUE, -c VALUE, bundled flags (-nq), --name,
+ * --name=VALUE, --name VALUE and unambiguous prefixes of long names.
+ * Unknown options and positional arguments are ignored; "--" stops
+ * parsing.
+ *
+ * @param values Receives each option's argument, by table index.
+ * @param given Set for each option present on the command line.
+ * @throws args::error on a missing or invalid argument, a repeated
+ *         option or an ambiguous prefix.
+ **/
+void parse(const option *options, std::size_t size, std::string_view *values,
+           bool *given, int argc, char *argv[]);
+
+/**
+ * @brief Parse all of text as a finite decimal number.
+ *
+ * libstdc++ only has floating point from_chars since GCC 11, so this
+ * goes through strtod(); everything that parses floats uses it.
+ **/
+bool to_real(std::string_view text, double &out);
+
+// Render options the way boost::program_options' description does.
+std::string help(const option *options, std::size_t size,
+                 std::string_view caption);
+
+/**
+ * @brief Parsed options for a fixed table of N options.
+ *
+ * Values are views into argv (or the table's fallbacks), so nothing is
+ * allocated until a string value is asked for.
+ **/
+template <std::size_t N>
+class variables
+{
+private:
+    const option (&m_options)[N];
+    std::array<std::string_view, N> m_values{};
+    std::array<bool, N> m_given{};
+
+public:
+    constexpr explicit variables(const option (&options)[N])
+        : m_options(options)
+    {
+    }
+
+    void parse(int argc, char *argv[])
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            m_values[i] = m_options[i].fallback;
+        args::parse(m_options, N, m_values.data(), m_given.data(), argc,
+                    argv);
+    }
+
+    // Like variables_map::count(); defaulted options count as present.
+    std::size_t count(std::string_view name) const
+    {
+        auto i = index(name);
+        return i < N && (m_given[i] || !m_options[i].fallback.empty());
+    }
+
+    // @throws std::out_of_range if name has no value.
+    value at(std::string_view name) const
+    {
+        if (!count(name))
+            throw std::out_of_range(std::string(name));
+        return value(m_values[index(name)]);
+    }
+
+    std::string help(std::string_view caption) const
+    {
+        return args::help(m_options, N, caption);
+    }
+
+private:
+    std::size_t index(std::string_view name) const
+    {
+        std::size_t i = 0;
+        while (i < N && m_options[i].name != name)
+            ++i;
+        return i;
+    }
+};
+
+}; // namespace args
+
+#endif /* ARGS_HPP */
@@ -0,0 +1,397 @@
+#include "audio.hpp"
+#include "clock.hpp"
+#include "signals.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace audio;
+
+fft::fft(std::size_t size)
+    : m_size(size)
+    , m_reverse(size)
+{
+    unsigned bits = 0;
+    while ((std::size_t(1) << bits) < size)
+        ++bits;
+    for (std::size_t i = 0; i < size; ++i) {
+        uint32_t r = 0;
+        for (unsigned b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_reverse[i] = r;
+    }
+
+    // Stage s (butterflies half = 2^s apart) uses twiddles
+    // [half - 1, 2 * half - 1).
+    for (std::size_t half = 1; half < size; half *= 2) {
+        for (std::size_t j = 0; j < half; ++j) {
+            double angle = -M_PI * j / half;
+            m_twiddle_re.push_back(std::cos(angle));
+            m_twiddle_im.push_back(std::sin(angle));
+        }
+    }
+}
+
+std::size_t fft::size(void) const
+{
+    return m_size;
+}
+
+// n butterflies between a and b, which never overlap.
+static void butterflies(float *__restrict ar, float *__restrict ai,
+                        float *__restrict br, float *__restrict bi,
+                        const float *__restrict wr,
+                        const float *__restrict wi, std::size_t n)
+{
+    for (std::size_t j = 0; j < n; ++j) {
+        float tr = br[j] * wr[j] - bi[j] * wi[j];
+        float ti = br[j] * wi[j] + bi[j] * wr[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+    }
+}
+
+void fft::transform(float *re, float *im) const
+{
+    for (std::size_t i = 0; i < m_size; ++i) {
+        std::size_t j = m_reverse[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (std::size_t half = 1; half < m_size; half *= 2) {
+        const float *wr = &m_twiddle_re[half - 1];
+        const float *wi = &m_twiddle_im[half - 1];
+        for (std::size_t start = 0; start < m_size; start += 2 * half) {
+            butterflies(re + start, im + start, re + start + half,
+                        im + start + half, wr, wi, half);
+        }
+    }
+}
+
+// Band edges in Hz: bass, low mids, high mids, treble.
+static constexpr double band_edges[band_count + 1] = {20.0, 250.0, 1000.0,
+                                                       4000.0, 16000.0};
+
+analyzer::analyzer(unsigned rate, unsigned fps)
+    : m_fft(window)
+    , m_window(window)
+    , m_re(window)
+    , m_im(window)
+{
+    for (std::size_t i = 0; i < window; ++i)
+        m_window[i] = 0.5 - 0.5 * std::cos(2.0 * M_PI * i / (window - 1));
+
+    // Every band gets at least one bin, even at low sample rates.
+    std::size_t last = 1;
+    for (std::size_t b = 0; b <= band_count; ++b) {
+        auto bin = static_cast<std::size_t>(band_edges[b] * window / rate);
+        last = std::min(std::max(bin, last + (b ? 1 : 0)), window / 2);
+        m_edges[b] = last;
+    }
+
+    // Peaks halve in about five seconds; levels fall to a tenth in
+    // about a fifth of a second.
+    m_peak_decay = std::pow(0.5, 1.0 / (5.0 * fps));
+    m_release = std::pow(0.1, 1.0 / (0.2 * fps));
+}
+
+// Below this a band is silence: about -60 dBFS for a sine in a
+// Hann-windowed bin.
+static constexpr float noise_floor = analyzer::window / 4 * 1e-3f;
+
+// Normalize v against a decaying peak and smooth its fall.
+static float level(float v, float &peak, float decay, float prev,
+                   float release)
+{
+    peak = std::max({v, peak * decay, noise_floor});
+    return std::max(v / peak, prev * release);
+}
+
+const bands &analyzer::analyze(const float *samples)
+{
+    for (std::size_t i = 0; i < window; ++i) {
+        m_re[i] = samples[i] * m_window[i];
+        m_im[i] = 0.0f;
+    }
+    m_fft.transform(m_re.data(), m_im.data());
+
+    float total = 0.0f;
+    for (std::size_t b = 0; b < band_count; ++b) {
+        float energy = 0.0f;
+        for (std::size_t k = m_edges[b]; k < m_edges[b + 1]; ++k)
+            energy += m_re[k] * m_re[k] + m_im[k] * m_im[k];
+        total += energy;
+
+        m_last.level[b] = level(std::sqrt(energy), m_peak[b], m_peak_decay,
+                                m_last.level[b], m_release);
+    }
+    m_last.loudness = level(std::sqrt(total), m_peak[band_count],
+                            m_peak_decay, m_last.loudness, m_release);
+    return m_last;
+}
+
+reader::reader(int fd, const format &fallback)
+    : m_fd(fd)
+    , m_format(fallback)
+{
+    struct stat st;
+    m_regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    read_header();
+}
+
+const format &reader::pcm_format(void) const
+{
+    return m_format;
+}
+
+bool reader::regular(void) const
+{
+    return m_regular;
+}
+
+static uint32_t le32(const char *p)
+{
+    auto *u = reinterpret_cast<const unsigned char *>(p);
+    return u[0] | (u[1] << 8) | (u[2] << 16) | (uint32_t(u[3]) << 24);
+}
+
+static uint16_t le16(const char *p)
+{
+    auto *u = reinterpret_cast<const unsigned char *>(p);
+    return u[0] | (u[1] << 8);
+}
+
+void reader::read_header(void)
+{
+    char riff[12];
+    std::size_t n = 0;
+    while (n < sizeof(riff)) {
+        ssize_t rc = ::read(m_fd, riff + n, sizeof(riff) - n);
+        if (rc == -1 && errno == EINTR && signals::running())
+            continue;
+        if (rc <= 0)
+            break;
+        n += rc;
+    }
+
+    if (n < sizeof(riff) || memcmp(riff, "RIFF", 4) ||
+        memcmp(riff + 8, "WAVE", 4)) {
+        // Raw PCM; what we read is already audio.
+        m_pending.assign(riff, riff + n);
+        return;
+    }
+
+    // Walk the chunks up to "data", picking up "fmt " on the way.
+    char chunk[8];
+    while (read_bytes(chunk, sizeof(chunk))) {
+        const uint32_t size = le32(chunk + 4);
+        if (!memcmp(chunk, "data", 4))
+            return;
+
+        // Chunks are padded to an even size; in 64 bits, so a size of
+        // 0xffffffff doesn't wrap around.
+        const uint64_t padded = uint64_t(size) + (size & 1);
+        if (memcmp(chunk, "fmt ", 4)) {
+            if (!skip_bytes(padded))
+                break;
+            continue;
+        }
+
+        // 16 bytes for plain PCM, up to 40 for WAVE_FORMAT_EXTENSIBLE.
+        if (size < 16 || size > 40)
+            throw std::runtime_error("Malformed WAV fmt chunk.");
+        char body[40];
+        if (!read_bytes(body, padded))
+            break;
+
+        // PCM, or WAVE_FORMAT_EXTENSIBLE wrapping it.
+        uint16_t tag = le16(&body[0]);
+        if ((tag != 1 && tag != 0xfffe) || le16(&body[14]) != 16 ||
+            !le16(&body[2]))
+            throw std::runtime_error("Only 16-bit PCM WAV is supported.");
+        if (!le32(&body[4]))
+            throw std::runtime_error("WAV sample rate is zero.");
+        m_format.channels = le16(&body[2]);
+        m_format.rate = le32(&body[4]);
+    }
+    throw std::runtime_error("WAV input has no data chunk.");
+}
+
+bool reader::read_bytes(char *buf, std::size_t size)
+{
+    std::size_t n = std::min(size, m_pending.size());
+    std::copy_n(m_pending.begin(), n, buf);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+
+    while (n < size) {
+        ssize_t rc = ::read(m_fd, buf + n, size - n);
+        if (rc == -1 && errno == EINTR && signals::running())
+            continue;
+        if (rc <= 0)
+            return false;
+        n += rc;
+    }
+    return true;
+}
+
+bool reader::skip_bytes(uint64_t size)
+{
+    // Whatever was read ahead goes first.
+    std::size_t n = std::min<uint64_t>(size, m_pending.size());
+    m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+    size -= n;
+
+    if (m_regular && size)
+        return lseek(m_fd, size, SEEK_CUR) != -1;
+
+    char buf[4096];
+    while (size) {
+        std::size_t piece = std::min<uint64_t>(size, sizeof(buf));
+        if (!read_bytes(buf, piece))
+            return false;
+        size -= piece;
+    }
+    return true;
+}
+
+bool reader::read(float *out, std::size_t count)
+{
+    const std::size_t channels = m_format.channels;
+    m_bytes.resize(count * channels * 2);
+    if (!read_bytes(m_bytes.data(), m_bytes.size()))
+        return false;
+
+    const float scale = 1.0f / (32768.0f * channels);
+    const char *p = m_bytes.data();
+    for (std::size_t i = 0; i < count; ++i) {
+        int sum = 0;
+        for (std::size_t c = 0; c < channels; ++c, p += 2)
+            sum += static_cast<int16_t>(le16(p));
+        out[i] = sum * scale;
+    }
+    return true;
+}
+
+std::size_t reader::backlog(void) const
+{
+    int n = 0;
+    if (m_regular || ioctl(m_fd, FIONREAD, &n) == -1)
+        return 0;
+    return n;
+}
+
+visualizer::visualizer(color::keyboard &kb,
+                       led::brightness<uint32_t> &brightness,
+                       fs::batch &batch)
+    : m_kb(kb)
+    , m_brightness(brightness)
+    , m_batch(batch)
+{
+}
+
+fs::commit_stats visualizer::commit(void)
+{
+    auto stats = m_kb.commit(m_batch);
+    stats += m_brightness.commit(m_batch);
+    try {
+        m_batch.submit();
+    } catch (...) {
+        m_kb.forget();
+        m_brightness.reload();
+        throw;
+    }
+    return stats;
+}
+
+effects::stats visualizer::run(reader &in, const effects::params &p,
+                               unsigned fps)
+{
+    signals::install();
+
+    const auto &fmt = in.pcm_format();
+    const std::size_t hop = std::max<std::size_t>(fmt.rate / fps, 1);
+    const std::size_t frame_bytes = hop * fmt.channels * 2;
+    constexpr std::size_t window = analyzer::window;
+
+    // The newest window samples, oldest first, behind whatever was
+    // read for the current frame.
+    std::vector<float> samples(window + hop);
+    analyzer a(fmt.rate, fps);
+
+    // Which band each zone follows, and how far it is lit (0-255).
+    const std::size_t zones = m_kb.size();
+    std::vector<std::size_t> zone_band(zones);
+    for (std::size_t i = 0; i < zones; ++i)
+        zone_band[i] = i * band_count / zones;
+    std::vector<uint8_t> factor(zones);
+
+    color::buffer colors(zones);
+    std::vector<uint8_t> last_factor;
+    uint32_t last_level = 0;
+
+    effects::stats st;
+    std::optional<timing::frame_clock> clock;
+    if (in.regular())
+        clock.emplace(fps);
+
+    while (signals::running()) {
+        std::copy(samples.end() - window, samples.end(), samples.begin());
+        if (!in.read(samples.data() + window, hop))
+            break;
+
+        if (clock) {
+            uint64_t elapsed;
+            while (!(elapsed = clock->wait()) && signals::running())
+                ;
+            st.dropped += elapsed ? elapsed - 1 : 0;
+        } else if (in.backlog() >= frame_bytes) {
+            // Writes fell behind the source; skip to fresher audio.
+            ++st.dropped;
+            continue;
+        }
+
+        const auto &b = a.analyze(samples.data() + hop);
+        ++st.frames;
+
+        for (std::size_t i = 0; i < zones; ++i)
+            factor[i] = std::lround(b.level[zone_band[i]] * 255.0f);
+        uint32_t level = std::lround(b.loudness * p.level);
+        if (factor == last_factor && level == last_level) {
+            ++st.unchanged;
+            continue;
+        }
+
+        // Scale each plane by its zone's factor.
+        const uint8_t *f = factor.data();
+        const uint8_t *planes[] = {p.colors.r(), p.colors.g(),
+                                   p.colors.b()};
+        uint8_t *out[] = {colors.r(), colors.g(), colors.b()};
+        for (std::size_t c = 0; c < 3; ++c) {
+            for (std::size_t i = 0; i < zones; ++i)
+                out[c][i] = (planes[c][i] * f[i] + 127) / 255;
+        }
+
+        m_kb.stage(colors);
+        m_brightness.stage_value(level);
+        st.writes += commit();
+        last_factor = factor;
+        last_level = level;
+    }
+
+    m_kb.stage(p.colors);
+    m_brightness.stage_value(p.level);
+    st.writes += commit();
+    return st;
+}
@@ -0,0 +1,187 @@
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+
+#include "batch.hpp"
+#include "brightness.hpp"
+#include "effects.hpp"
+#include "keyboard.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace audio
+{
+
+// Layout of raw PCM input; WAV input brings its own.
+struct format {
+    unsigned rate = 44100;
+    unsigned channels = 2;
+};
+
+/**
+ * @brief In-place radix-2 FFT of a fixed power of two size.
+ *
+ * Real and imaginary parts are kept in separate arrays and the
+ * twiddles of every stage are laid out contiguously, so each stage's
+ * butterflies are a plain loop over floats the compiler vectorizes.
+ **/
+class fft
+{
+private:
+    std::size_t m_size;
+    std::vector<uint32_t> m_reverse;
+    std::vector<float> m_twiddle_re;
+    std::vector<float> m_twiddle_im;
+
+public:
+    explicit fft(std::size_t size);
+
+    std::size_t size(void) const;
+
+    // Transform size() values of re and im in place.
+    void transform(float *re, float *im) const;
+};
+
+// Frequency bands a frame is split into, lowest first.
+constexpr std::size_t band_count = 4;
+
+// Result of analyzing one frame; every value is in [0, 1].
+struct bands {
+    std::array<float, band_count> level;
+    float loudness = 0.0f;
+};
+
+/**
+ * @brief Turns windows of samples into band levels.
+ *
+ * Energies are normalized against a slowly decaying peak per band, so
+ * quiet and loud material both use the whole range, and fall off
+ * gradually rather than flickering.
+ **/
+class analyzer
+{
+public:
+    // Samples per window; about 11 ms at 44.1 kHz.
+    static constexpr std::size_t window = 512;
+
+private:
+    fft m_fft;
+    std::vector<float> m_window;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+
+    // FFT bin range [first, last) of each band.
+    std::array<std::size_t, band_count + 1> m_edges;
+
+    std::array<float, band_count + 1> m_peak{};
+    bands m_last;
+    float m_peak_decay;
+    float m_release;
+
+public:
+    /**
+     * @param rate Sample rate in Hz.
+     * @param fps Windows analyzed per second.
+     **/
+    analyzer(unsigned rate, unsigned fps);
+
+    /**
+     * @brief Analyze window mono samples in [-1, 1], oldest first.
+     *
+     * Doesn't allocate.
+     **/
+    const bands &analyze(const float *samples);
+};
+
+/**
+ * @brief Reads PCM frames from a descriptor, downmixed to mono.
+ *
+ * Input starting with a RIFF/WAVE header is parsed as a 16-bit PCM
+ * WAV file and its format replaces the one given; anything else is
+ * taken as raw s16le.
+ **/
+class reader
+{
+private:
+    int m_fd;
+    format m_format;
+    bool m_regular = false;
+
+    // Raw bytes of the frames being read, and bytes of the stream
+    // consumed while looking for a header.
+    std::vector<char> m_bytes;
+    std::vector<char> m_pending;
+
+public:
+    /**
+     * @throws std::runtime_error on WAV input that isn't 16-bit PCM.
+     **/
+    reader(int fd, const format &fallback);
+
+    const format &pcm_format(void) const;
+
+    // Whether input comes from a regular file rather than a live
+    // source like a pipe.
+    bool regular(void) const;
+
+    /**
+     * @brief Read exactly count frames into out.
+     *
+     * @returns false at end of input or once SIGINT/SIGTERM arrived.
+     **/
+    bool read(float *out, std::size_t count);
+
+    // Bytes waiting to be read from a live source.
+    std::size_t backlog(void) const;
+
+private:
+    void read_header(void);
+    bool read_bytes(char *buf, std::size_t size);
+
+    // Discard size bytes without buffering them.
+    bool skip_bytes(uint64_t size);
+};
+
+/**
+ * @brief Drives a keyboard from audio.
+ *
+ * Each frame, the newest analyzer::window samples are analyzed; the
+ * four bands (bass to treble) scale the base colors of the zones they
+ * map to, in keyboard order, and the overall loudness scales the
+ * brightness. Frames go through the stage/commit path, so only
+ * changes are written, and nothing is allocated per frame.
+ *
+ * Regular files are played back in real time. Live input is paced by
+ * its producer; when writes fall behind and more than a frame of audio
+ * is waiting, stale frames are dropped unanalyzed.
+ **/
+class visualizer
+{
+private:
+    color::keyboard &m_kb;
+    led::brightness<uint32_t> &m_brightness;
+    fs::batch &m_batch;
+
+public:
+    visualizer(color::keyboard &kb, led::brightness<uint32_t> &brightness,
+               fs::batch &batch);
+
+    /**
+     * @brief Play until input ends or SIGINT/SIGTERM arrives.
+     *
+     * When playback stops, the base colors and level in p are restored.
+     *
+     * @param in Audio source.
+     * @param p Base colors and level; period is unused.
+     * @param fps Frames per second.
+     **/
+    effects::stats run(reader &in, const effects::params &p, unsigned fps);
+
+private:
+    fs::commit_stats commit(void);
+};
+
+}; // namespace audio
+
+#endif /* AUDIO_HPP */
@@ -0,0 +1,147 @@
+#include "batch.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include <cstring>
+#include <exception>
+#include <system_error>
+
+using namespace fs;
+
+batch::batch(backend b)
+    : m_backend(b)
+{
+}
+
+void batch::select(backend b)
+{
+    m_backend = b;
+    if (b == backend::pwrite)
+        m_ring.reset();
+}
+
+batch::backend batch::active(void) const
+{
+    if (m_backend == backend::automatic)
+        return m_ring ? backend::uring : backend::pwrite;
+    return m_backend;
+}
+
+void batch::write(node &target, const char *buf, std::size_t size)
+{
+    if (size > sizeof(entry::buf))
+        throw std::system_error(EINVAL, std::generic_category(),
+                                target.path());
+    if (m_size == capacity)
+        submit();
+
+    auto &e = m_entries[m_size++];
+    e.target = &target;
+    memcpy(e.buf, buf, size);
+    e.size = size;
+}
+
+std::size_t batch::size(void) const
+{
+    return m_size;
+}
+
+void batch::submit(void)
+{
+    if (!m_size)
+        return;
+
+    // The ring is set up on the first batch worth sending through it.
+    if (m_backend != backend::pwrite && !m_ring && m_size > 1) {
+        try {
+            m_ring.emplace();
+        } catch (std::system_error &e) {
+            if (m_backend == backend::uring) {
+                m_size = 0;
+                throw;
+            }
+            logging::debug("io_uring unavailable, using pwrite:",
+                           std::string(e.what()));
+            m_backend = backend::pwrite;
+        }
+    }
+
+    if (m_ring && m_size > 1)
+        submit_uring();
+    else
+        submit_pwrite();
+}
+
+void batch::submit_pwrite(void)
+{
+    std::exception_ptr first;
+    for (std::size_t i = 0; i < m_size; ++i) {
+        auto &e = m_entries[i];
+        try {
+            e.target->write(e.buf, e.size);
+        } catch (std::system_error &error) {
+            if (first)
+                logging::error(std::string(error.what()));
+            else
+                first = std::current_exception();
+        }
+    }
+
+    m_size = 0;
+    if (first)
+        std::rethrow_exception(first);
+}
+
+void batch::submit_uring(void)
+{
+    uring::write_op ops[capacity];
+    std::exception_ptr first;
+
+    // Descriptors are opened up front; a node that can't be opened
+    // fails on its own without holding up the rest.
+    std::size_t count = 0;
+    std::size_t index[capacity];
+    for (std::size_t i = 0; i < m_size; ++i) {
+        auto &e = m_entries[i];
+        try {
+            ops[count] = {e.target->write_fd(), &e.target->path(), e.buf,
+                          e.size, 0};
+            index[count++] = i;
+        } catch (std::system_error &error) {
+            if (first)
+                logging::error(std::string(error.what()));
+            else
+                first = std::current_exception();
+        }
+    }
+
+    // Writes in one submission run together; each is charged the whole
+    // submission's latency.
+    uint64_t started = metrics::now();
+    try {
+        m_ring->submit(ops, count);
+    } catch (...) {
+        // The ring is in an unknown state; drop it and fall back to
+        // pwrite for good unless io_uring was asked for explicitly.
+        m_ring.reset();
+        if (m_backend == backend::automatic)
+            m_backend = backend::pwrite;
+        m_size = 0;
+        throw;
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        auto &e = m_entries[index[i]];
+        try {
+            e.target->complete_write(ops[i].result, e.size, started);
+        } catch (std::system_error &error) {
+            if (first)
+                logging::error(std::string(error.what()));
+            else
+                first = std::current_exception();
+        }
+    }
+
+    m_size = 0;
+    if (first)
+        std::rethrow_exception(first);
+}
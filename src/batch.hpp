@@ -0,0 +1,100 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "fs.hpp"
+#include "uring.hpp"
+#include <cstddef>
+#include <optional>
+
+namespace fs
+{
+
+/**
+ * @brief Attribute writes collected and submitted together.
+ *
+ * Commits queue their writes here instead of issuing them one by one;
+ * submit() then hands all of them to the kernel. With the io_uring
+ * backend a whole frame (four colors and a brightness level) costs a
+ * single io_uring_enter(2) instead of five pwrite(2)s.
+ *
+ * Fewer syscalls don't make io_uring faster here, though: attribute
+ * writes can't complete inline and get punted to io-wq workers, so
+ * pwrite stays the default and io_uring is opt-in (--io-uring) for
+ * the long-lived writers, the daemon and effects.
+ **/
+class batch
+{
+public:
+    enum class backend {
+        // io_uring when the kernel has it, pwrite otherwise.
+        automatic,
+        pwrite,
+        uring,
+    };
+
+    // Writes held before submit() is called implicitly.
+    static constexpr std::size_t capacity = uring::entries;
+
+private:
+    struct entry {
+        node *target;
+        char buf[32];
+        uint32_t size;
+    };
+
+    entry m_entries[capacity];
+    std::size_t m_size = 0;
+
+    backend m_backend;
+    std::optional<uring> m_ring;
+
+public:
+    explicit batch(backend b = backend::pwrite);
+
+    batch(const batch &) = delete;
+    batch &operator=(const batch &) = delete;
+
+    /**
+     * @brief Switch backends; pending writes are kept.
+     **/
+    void select(backend b);
+
+    /**
+     * @brief The backend the next submit() uses.
+     *
+     * backend::automatic resolves to pwrite once io_uring turned out
+     * to be unavailable, and to uring after a ring was set up.
+     **/
+    backend active(void) const;
+
+    /**
+     * @brief Queue a write of size bytes from buf to target.
+     *
+     * buf is copied; target must outlive the next submit().
+     **/
+    void write(node &target, const char *buf, std::size_t size);
+
+    // Number of queued writes.
+    std::size_t size(void) const;
+
+    /**
+     * @brief Perform every queued write and wait for all of them.
+     *
+     * Every write is attempted even if some of them fail; the queue
+     * is empty afterwards either way.
+     *
+     * @throws std::system_error for the first write that failed, with
+     *         its attribute path as message; further failures are
+     *         logged. Also thrown if a forced backend::uring is
+     *         unavailable.
+     **/
+    void submit(void);
+
+private:
+    void submit_pwrite(void);
+    void submit_uring(void);
+};
+
+}; // namespace fs
+
+#endif /* BATCH_HPP */
@@ -0,0 +1,621 @@
+/**
+ * @brief Micro and macro benchmarks for the `system76-kbd-led` write path.
+ *
+ * This binary is built with SYSFS_PREFIX, CACHE_PREFIX and SOCKET_PATH
+ * pointing into BENCH_PREFIX (a tmpfs by default), where it lays out a
+ * fake sysfs tree before running. Each benchmark reports ns/op,
+ * allocations/op (counted through the global operator new) and
+ * syscalls/op (counted at the libc boundary for the file and socket
+ * calls this program makes).
+ *
+ * The frame/ benchmarks commit one effect frame through each fs::batch
+ * backend; io_uring's syscalls are counted through syscall(3).
+ *
+ * The startup/ benchmarks spawn BENCH_CLI, the program built against
+ * the same fake tree, and wait for it to exit; their ns/op is the wall
+ * time from exec to exit, while syscalls and allocations are only
+ * those of this process.
+ *
+ * usage: system76-kbd-led-bench [--filter <substr>] [--min-ms <ms>]
+ *                               [--json <path>]
+ *
+ * @author Kevin Morris
+ * @license MIT
+ **/
+#include "app.hpp"
+#include "audio.hpp"
+#include "cli.hpp"
+#include "color/hex.hpp"
+#include "color/space.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "timeline.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <spawn.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef BENCH_PREFIX
+#error "BENCH_PREFIX must be defined for the benchmark build."
+#endif
+
+#ifndef BENCH_CLI
+#error "BENCH_CLI must point at the benchmark build of the program."
+#endif
+
+namespace counters
+{
+std::atomic<uint64_t> allocs{0};
+std::atomic<uint64_t> syscalls{0};
+}; // namespace counters
+
+// Allocation counting.
+
+void *operator new(std::size_t size)
+{
+    ++counters::allocs;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    free(p);
+}
+
+// Syscall counting: interpose the libc wrappers used by this program
+// (directly or through libstdc++'s filebuf) and forward to the real ones.
+
+#define REAL(name)                                                            \
+    static auto real = reinterpret_cast<decltype(&name)>(                     \
+        dlsym(RTLD_NEXT, #name));                                             \
+    ++counters::syscalls
+
+extern "C" {
+
+int open(const char *path, int flags, ...)
+{
+    REAL(open);
+    va_list ap;
+    va_start(ap, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(ap, mode_t) : 0;
+    va_end(ap);
+    return real(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    REAL(open64);
+    va_list ap;
+    va_start(ap, flags);
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(ap, mode_t) : 0;
+    va_end(ap);
+    return real(path, flags, mode);
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+    REAL(fopen);
+    return real(path, mode);
+}
+
+FILE *fopen64(const char *path, const char *mode)
+{
+    REAL(fopen64);
+    return real(path, mode);
+}
+
+int fclose(FILE *stream)
+{
+    REAL(fclose);
+    return real(stream);
+}
+
+int close(int fd)
+{
+    REAL(close);
+    return real(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t n)
+{
+    REAL(read);
+    return real(fd, buf, n);
+}
+
+ssize_t write(int fd, const void *buf, size_t n)
+{
+    REAL(write);
+    return real(fd, buf, n);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int n)
+{
+    REAL(writev);
+    return real(fd, iov, n);
+}
+
+ssize_t pread64(int fd, void *buf, size_t n, off64_t offset)
+{
+    REAL(pread64);
+    return real(fd, buf, n, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t n, off64_t offset)
+{
+    REAL(pwrite64);
+    return real(fd, buf, n, offset);
+}
+
+ssize_t pread(int fd, void *buf, size_t n, off_t offset)
+{
+    REAL(pread);
+    return real(fd, buf, n, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t n, off_t offset)
+{
+    REAL(pwrite);
+    return real(fd, buf, n, offset);
+}
+
+int ftruncate(int fd, off_t length)
+{
+    REAL(ftruncate);
+    return real(fd, length);
+}
+
+int access(const char *path, int mode)
+{
+    REAL(access);
+    return real(path, mode);
+}
+
+int mkdir(const char *path, mode_t mode)
+{
+    REAL(mkdir);
+    return real(path, mode);
+}
+
+int rename(const char *from, const char *to)
+{
+    REAL(rename);
+    return real(from, to);
+}
+
+int unlink(const char *path)
+{
+    REAL(unlink);
+    return real(path);
+}
+
+int socket(int domain, int type, int protocol)
+{
+    REAL(socket);
+    return real(domain, type, protocol);
+}
+
+int connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    REAL(connect);
+    return real(fd, addr, len);
+}
+
+// io_uring has no libc wrappers; fs::uring goes through syscall(2).
+long syscall(long number, ...)
+{
+    REAL(syscall);
+    va_list ap;
+    va_start(ap, number);
+    long a[6];
+    for (auto &arg : a)
+        arg = va_arg(ap, long);
+    va_end(ap);
+    return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+} // extern "C"
+
+// Benchmark harness.
+
+struct result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double syscalls_per_op;
+    double allocs_per_op;
+};
+
+struct options {
+    std::string filter;
+    std::string json;
+    double min_ms = 200.0;
+};
+
+static void write_file(const std::string &path, const char *data)
+{
+    FILE *f = ::fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        exit(1);
+    }
+    fputs(data, f);
+    ::fclose(f);
+}
+
+// Lay out a fresh fake sysfs tree and an empty cache directory.
+static void setup_tree(void)
+{
+    std::string prefix(BENCH_PREFIX);
+    std::string cmd = "rm -rf '" + prefix + "' && mkdir -p '" + prefix +
+                      "sys' '" + prefix + "cache'";
+    if (system(cmd.c_str()) != 0) {
+        fprintf(stderr, "unable to create %s\n", BENCH_PREFIX);
+        exit(1);
+    }
+
+    for (auto name : {"color_left", "color_center", "color_right",
+                      "color_extra"})
+        write_file(std::string(SYSFS_PREFIX) + name, "FFFFFF\n");
+    write_file(BRIGHTNESS_PATH, "48\n");
+    write_file(MAX_BRIGHTNESS_PATH, "255\n");
+    write_file(HW_BRIGHTNESS_PATH, "48\n");
+}
+
+template <typename Fn>
+static result measure(const std::string &name, const options &opts, Fn &&fn)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Warm up descriptors, caches and lazily bound symbols.
+    for (int i = 0; i < 16; ++i)
+        fn(i);
+
+    uint64_t iterations = 0;
+    uint64_t batch = 64;
+    double elapsed_ns = 0;
+    uint64_t allocs = counters::allocs;
+    uint64_t syscalls = counters::syscalls;
+
+    while (elapsed_ns < opts.min_ms * 1e6) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < batch; ++i)
+            fn(iterations + i);
+        auto end = clock::now();
+        elapsed_ns +=
+            std::chrono::duration<double, std::nano>(end - start).count();
+        iterations += batch;
+        batch *= 2;
+    }
+
+    double n = static_cast<double>(iterations);
+    return {name, iterations, elapsed_ns / n,
+            (counters::syscalls - syscalls) / n,
+            (counters::allocs - allocs) / n};
+}
+
+// Keep the optimizer from discarding benchmarked work.
+template <typename T>
+static void keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+static std::vector<result> run_all(const options &opts)
+{
+    std::vector<result> results;
+    auto bench = [&](const std::string &name, auto &&fn) {
+        if (!opts.filter.empty() && name.find(opts.filter) ==
+                                        std::string::npos)
+            return;
+        results.push_back(measure(name, opts, fn));
+        auto &r = results.back();
+        fprintf(stderr, "%-28s %12.1f ns/op %8.2f syscalls/op %8.2f "
+                        "allocs/op\n",
+                r.name.c_str(), r.ns_per_op, r.syscalls_per_op,
+                r.allocs_per_op);
+    };
+
+    // Color codec.
+    const char *samples[] = {"ff8800", "00FF7f", "123abc", "deadbe"};
+    bench("rgb/parse", [&](uint64_t i) {
+        color::rgb c(std::string_view(samples[i & 3], 6));
+        keep(c);
+    });
+
+    bench("rgb/to_chars", [&](uint64_t i) {
+        char buf[6];
+        color::to_chars(buf, buf + sizeof(buf), color::rgb(i & 0xffffff));
+        keep(buf);
+    });
+
+    bench("rgb/to_string", [&](uint64_t i) {
+        auto s = std::to_string(color::rgb(i & 0xffffff));
+        keep(s);
+    });
+
+    std::string packed;
+    for (uint32_t i = 0; i < 4096; ++i) {
+        char buf[6];
+        color::hex::encode(buf, i * 2654435761u);
+        packed.append(buf, sizeof(buf));
+    }
+    std::vector<uint32_t> decoded(4096);
+    bench("hex/decode_batch(4096)", [&](uint64_t) {
+        color::hex::decode_batch(packed.data(), decoded.size(),
+                                 decoded.data());
+        keep(decoded);
+    });
+
+    // Color spaces: one perceptual mix, and a per-key keyboard's worth
+    // of gradient through the batch kernels.
+    bench("space/mix(oklab)", [&](uint64_t i) {
+        auto c = color::mix(color::rgb(i & 0xffffff), color::rgb(0x0000ff),
+                            0.25f, color::space::oklab);
+        keep(c);
+    });
+
+    {
+        const color::rgb stops[] = {color::rgb(0xff0000),
+                                    color::rgb(0x00ff00),
+                                    color::rgb(0x0000ff)};
+        color::buffer keys(128);
+        bench("space/gradient(oklab, 128)", [&](uint64_t) {
+            color::gradient(stops, 3, color::space::oklab, keys);
+            keep(keys);
+        });
+    }
+
+    // One audio frame's analysis; the budget at 60 fps is 16.7 ms.
+    {
+        audio::analyzer analyzer(44100, 60);
+        std::vector<float> samples(audio::analyzer::window);
+        for (std::size_t i = 0; i < samples.size(); ++i)
+            samples[i] = std::sin(i * 0.3) * 0.5;
+        bench("audio/analyze(512)", [&](uint64_t) {
+            keep(analyzer.analyze(samples.data()));
+        });
+    }
+
+    // One show frame: a blended sample of a compiled timeline.
+    {
+        std::string src = std::string(BENCH_PREFIX) + "show.txt";
+        std::string bin = std::string(BENCH_PREFIX) + "show.bin";
+        {
+            std::ofstream ofs(src);
+            ofs << "loop\n";
+            for (int i = 0; i < 4096; ++i)
+                ofs << i * 0.25 << " ff0000 00ff00 0000ff ffffff "
+                    << (i & 0xff) << (i & 1 ? " smooth\n" : "\n");
+        }
+        timeline::compile(src, bin);
+        timeline::show show(bin);
+        timeline::frame f;
+        std::size_t index = 0;
+        bench("timeline/sample", [&](uint64_t i) {
+            index = timeline::sample(show, (i * 17) % show.duration(), index,
+                                     f);
+            keep(f);
+        });
+    }
+
+    // Caches.
+    {
+        fs::state_file file;
+        fs::color_cache color_cache(file);
+        using namespace color::literals;
+        color_cache.set_data(
+            {"ff0000"_rgb, "00ff00"_rgb, "0000ff"_rgb, "ffffff"_rgb});
+        bench("color_cache/data", [&](uint64_t) {
+            auto colors = color_cache.data();
+            keep(colors);
+        });
+    }
+
+    bench("cache/round_trip", [&](uint64_t i) {
+        fs::state_file file;
+        fs::brightness_cache<uint32_t> cache(file);
+        cache.set_data(i & 0xff);
+        file.flush();
+        keep(cache);
+    });
+
+    // What every attribute access pays for its metrics.
+    {
+        auto *f = metrics::lookup(BENCH_PREFIX "metrics");
+        bench("metrics/record", [&](uint64_t) {
+            metrics::record(f, metrics::op::write, metrics::now(), true);
+        });
+    }
+
+    // Sysfs attributes on the fake tree.
+    color::keyboard kb;
+    bench("zone/write", [&](uint64_t i) {
+        kb.stage(0, color::rgb(i & 0xffffff));
+        keep(kb.force_commit());
+    });
+
+    bench("zone/read", [&](uint64_t) {
+        kb.forget();
+        keep(kb.color(0));
+    });
+
+    led::brightness<uint32_t> brightness;
+    bench("brightness/set_value", [&](uint64_t i) {
+        brightness.set_value(i & 0xff);
+    });
+
+    bench("keyboard/commit(1 region)", [&](uint64_t i) {
+        kb.stage(0, color::rgb(i & 0xffffff));
+        kb.stage(kb.pending());
+        auto stats = kb.commit();
+        keep(stats);
+    });
+
+    // One effect frame: every attribute changes, committed as a batch.
+    // At 60 fps a frame has 16.7 ms; this is what it costs of that.
+    // Both backends pay an extra ftruncate per write on the fake tree.
+    auto frame = [&](const std::string &name, fs::batch::backend b) {
+        fs::batch batch(b);
+        try {
+            if (b == fs::batch::backend::uring)
+                fs::uring ring;
+        } catch (std::system_error &e) {
+            std::cerr << name << ": skipped, " << e.what() << std::endl;
+            return;
+        }
+        bench(name, [&](uint64_t i) {
+            kb.stage(color::rgb((i * 0x010203) & 0xffffff));
+            brightness.stage_value(i & 0xff);
+            auto stats = kb.commit(batch);
+            stats += brightness.commit(batch);
+            batch.submit();
+            keep(stats);
+        });
+    };
+    frame("frame/pwrite(5 attributes)", fs::batch::backend::pwrite);
+    frame("frame/io_uring(5 attributes)", fs::batch::backend::uring);
+
+    // End to end: a full command line invocation, minus exec().
+    int devnull = ::open("/dev/null", O_WRONLY);
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+
+    char arg0[] = "system76-kbd-led", arg1[] = "-n", arg2[] = "-l",
+         arg4[] = "-b";
+    char color_arg[8], level_arg[8];
+    char *argv[] = {arg0, arg1, arg2, color_arg, arg4, level_arg, nullptr};
+    bench("main(-n -l <rgb> -b <n>)", [&](uint64_t i) {
+        color::hex::encode(color_arg, i & 0xffffff);
+        color_arg[6] = '\0';
+        snprintf(level_arg, sizeof(level_arg), "%u",
+                 static_cast<unsigned>(i & 0xff));
+        cli::run(6, argv);
+    });
+
+    // The boot-time restore; the run above left a state file behind.
+    char arg_q[] = "-q", arg_x[] = "-x";
+    char *restore_argv[] = {arg0, arg1, arg_q, arg_x, nullptr};
+    bench("main(-n -q -x)", [&](uint64_t) { cli::run(4, restore_argv); });
+
+    // Exec to exit, for the invocations hotkeys and the boot service use.
+    const std::vector<std::vector<std::string>> startups = {
+        {"-i", "10"}, {"-t"}, {"-q", "-x"}};
+    for (auto &args : startups) {
+        std::string name = "startup(";
+        std::vector<char *> child_argv{const_cast<char *>(BENCH_CLI)};
+        for (auto &arg : args) {
+            name += (child_argv.size() > 1 ? " " : "") + arg;
+            child_argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        child_argv.push_back(nullptr);
+        name += ")";
+
+        bench(name, [&](uint64_t) {
+            pid_t pid;
+            int status;
+            if (posix_spawn(&pid, BENCH_CLI, nullptr, nullptr,
+                            child_argv.data(), environ) == 0)
+                waitpid(pid, &status, 0);
+        });
+    }
+
+    std::cout.flush();
+    dup2(saved, STDOUT_FILENO);
+    ::close(saved);
+    ::close(devnull);
+
+    return results;
+}
+
+static void write_json(const std::string &path,
+                       const std::vector<result> &results)
+{
+    FILE *f = path == "-" ? stdout : ::fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        exit(1);
+    }
+
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        fprintf(f,
+                "    {\"name\": \"%s\", \"iterations\": %llu, "
+                "\"ns_per_op\": %.2f, \"syscalls_per_op\": %.3f, "
+                "\"allocs_per_op\": %.3f}%s\n",
+                r.name.c_str(), static_cast<unsigned long long>(r.iterations),
+                r.ns_per_op, r.syscalls_per_op, r.allocs_per_op,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    if (f != stdout)
+        ::fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (arg == "--min-ms" && i + 1 < argc) {
+            opts.min_ms = atof(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            opts.json = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--filter <substr>] [--min-ms <ms>] "
+                    "[--json <path>]\n",
+                    argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    logging::set_debug(false);
+    setup_tree();
+
+    auto results = run_all(opts);
+    if (!opts.json.empty())
+        write_json(opts.json, results);
+    return 0;
+}
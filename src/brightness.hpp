@@ -1,16 +1,22 @@
 #ifndef BRIGHTNESS_HPP
 #define BRIGHTNESS_HPP
 
-#include "cache.hpp"
+#include "batch.hpp"
 #include "fs.hpp"
+#include "state_file.hpp"
+#include <charconv>
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <system_error>
 
-#define BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, "brightness")
-#define MAX_BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, "max_brightness")
-#define HW_BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, "brightness_hw_changed")
+#define BRIGHTNESS_FILE "brightness"
+#define MAX_BRIGHTNESS_FILE "max_brightness"
+#define HW_BRIGHTNESS_FILE "brightness_hw_changed"
 
-#define BRIGHTNESS_CACHE JOIN(CACHE_PREFIX, "brightness")
-#define HW_BRIGHTNESS_CACHE JOIN(CACHE_PREFIX, "hw_brightness")
+#define BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, BRIGHTNESS_FILE)
+#define MAX_BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, MAX_BRIGHTNESS_FILE)
+#define HW_BRIGHTNESS_PATH JOIN(SYSFS_PREFIX, HW_BRIGHTNESS_FILE)
 
 namespace led
 {
@@ -19,75 +25,212 @@ template <typename T>
 class brightness
 {
 private:
-    inline static T m_level = 0;
-    inline static T m_hw_level = 0;
-    inline static T m_max_level = 255;
+    // Attribute values, each read from sysfs the first time it's needed.
+    mutable std::optional<T> m_level;
+    mutable std::optional<T> m_hw_level;
+    mutable std::optional<T> m_max_level;
+
+    // Level waiting for the next commit(), if any.
+    std::optional<T> m_staged;
+
+    mutable fs::node m_node{BRIGHTNESS_PATH};
+    mutable fs::node m_max_node{MAX_BRIGHTNESS_PATH};
+    mutable fs::node m_hw_node{HW_BRIGHTNESS_PATH};
 
 public:
-    brightness(void)
+    // Nothing is read from sysfs until a value is actually needed.
+    brightness(void) = default;
+
+    // The LED whose attributes live in dir.
+    explicit brightness(const std::string &dir)
+        : m_node(dir + BRIGHTNESS_FILE)
+        , m_max_node(dir + MAX_BRIGHTNESS_FILE)
+        , m_hw_node(dir + HW_BRIGHTNESS_FILE)
     {
-        init();
     }
 
     void increment(int value)
     {
-        int tmp = m_level;
-        tmp += value;
-        if (tmp > m_max_level)
-            tmp = m_max_level;
-        else if (tmp < 0)
-            tmp = 0;
-        m_level = tmp;
-
-        auto stream = fs::open(BRIGHTNESS_PATH, std::ios::out);
-        stream << m_level;
-        stream.close();
+        set_value(static_cast<int>(level()) + value);
     }
 
     void set_value(int value)
     {
-        if (value > m_max_level)
-            value = m_max_level;
-        else if (value < 0)
-            value = 0;
-        m_level = value;
+        m_level = clamp(value);
+        write(m_node, *m_level);
+    }
+
+    /**
+     * @brief Stage an absolute level for the next commit().
+     **/
+    void stage_value(int value)
+    {
+        m_staged = clamp(value);
+    }
+
+    /**
+     * @brief Stage a level known to be valid for this device.
+     *
+     * Unlike stage_value() this doesn't clamp, so max_brightness is
+     * never read; use it for levels that came from the device earlier,
+     * like the cached one restored at boot.
+     **/
+    void stage_trusted(T value)
+    {
+        m_staged = value;
+    }
+
+    /**
+     * @brief Stage an increment relative to the pending level.
+     **/
+    void stage_increment(int value)
+    {
+        m_staged = clamp(static_cast<int64_t>(pending_level()) + value);
+    }
 
-        auto stream = fs::open(BRIGHTNESS_PATH, std::ios::out);
-        stream << m_level;
-        stream.close();
+    /**
+     * @brief Write the staged level, if it differs from hardware.
+     **/
+    fs::commit_stats commit(void)
+    {
+        fs::batch batch;
+        auto stats = commit(batch);
+        batch.submit();
+        return stats;
     }
 
-    const T &level(void) const
+    /**
+     * @brief Like commit(), with the write queued on batch.
+     *
+     * If the batch fails, reload() the level.
+     **/
+    fs::commit_stats commit(fs::batch &batch)
     {
-        return m_level;
+        fs::commit_stats stats;
+        if (!m_staged)
+            return stats;
+
+        if (*m_staged != level()) {
+            m_level = *m_staged;
+            write(batch, m_node, *m_level);
+            ++stats.written;
+        } else {
+            ++stats.skipped;
+        }
+        m_staged.reset();
+        return stats;
     }
 
-    const T &hw_level(void) const
+    /**
+     * @brief Write the staged level without reading hardware to compare.
+     **/
+    fs::commit_stats force_commit(void)
     {
-        return m_hw_level;
+        fs::batch batch;
+        auto stats = force_commit(batch);
+        batch.submit();
+        return stats;
     }
 
-    const T &max_level(void) const
+    fs::commit_stats force_commit(fs::batch &batch)
     {
-        return m_max_level;
+        fs::commit_stats stats;
+        if (!m_staged)
+            return stats;
+
+        m_level = *m_staged;
+        write(batch, m_node, *m_level);
+        ++stats.written;
+        m_staged.reset();
+        return stats;
+    }
+
+    // Whether a level is waiting for the next commit().
+    bool staged(void) const
+    {
+        return m_staged.has_value();
+    }
+
+    // The level brightness will have after the next commit().
+    T pending_level(void) const
+    {
+        return m_staged ? *m_staged : level();
+    }
+
+    /**
+     * @brief Forget the level and hw_level read from sysfs.
+     *
+     * max_level never changes for a device, so long-lived owners
+     * (the daemon) use this to pick up changes made behind their
+     * back, e.g. by the firmware's Fn keys. Both are read again the
+     * next time they are needed.
+     **/
+    void reload(void)
+    {
+        m_level.reset();
+        m_hw_level.reset();
+    }
+
+    T level(void) const
+    {
+        if (!m_level)
+            m_level = read(m_node);
+        return *m_level;
+    }
+
+    T hw_level(void) const
+    {
+        // brightness_hw_changed is missing on older kernels; treat it
+        // as optional like we always have.
+        if (!m_hw_level) {
+            try {
+                m_hw_level = read(m_hw_node);
+            } catch (std::system_error &) {
+                m_hw_level = 0;
+            }
+        }
+        return *m_hw_level;
+    }
+
+    T max_level(void) const
+    {
+        if (!m_max_level)
+            m_max_level = read(m_max_node, 255);
+        return *m_max_level;
     }
 
 private:
-    void init(void)
+    T clamp(int64_t value) const
     {
-        auto stream = fs::open(HW_BRIGHTNESS_PATH, std::ios::in);
-        T b;
-        if ((stream >> b))
-            m_hw_level = b;
-        stream.close();
+        if (value > static_cast<int64_t>(max_level()))
+            return max_level();
+        else if (value < 0)
+            return 0;
+        return value;
+    }
 
-        stream = fs::open(MAX_BRIGHTNESS_PATH, std::ios::in);
-        stream >> m_max_level;
-        stream.close();
+    // Parse a decimal attribute; fallback is returned on garbage.
+    static T read(fs::node &node, T fallback = 0)
+    {
+        char buf[32];
+        auto n = node.read(buf, sizeof(buf));
+        T value;
+        auto [ptr, ec] = std::from_chars(buf, buf + n, value);
+        return ec == std::errc() ? value : fallback;
+    }
 
-        stream = fs::open(BRIGHTNESS_PATH, std::ios::in);
-        stream >> m_level;
-        stream.close();
+    static void write(fs::node &node, const T &value)
+    {
+        char buf[32];
+        auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+        node.write(buf, ptr - buf);
+    }
+
+    static void write(fs::batch &batch, fs::node &node, const T &value)
+    {
+        char buf[32];
+        auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+        batch.write(node, buf, ptr - buf);
     }
 };
 
@@ -96,25 +239,13 @@ private:
 namespace fs
 {
 
+// Last non-zero brightness level, restored by -x and -t.
 template <typename T>
-class brightness_cache : public cache<T>
-{
-public:
-    brightness_cache(void)
-        : cache<T>(BRIGHTNESS_CACHE)
-    {
-    }
-};
+using brightness_cache = level_cache<T, state_file::brightness>;
 
+// Last value seen in brightness_hw_changed.
 template <typename T>
-class hw_brightness_cache : public fs::cache<T>
-{
-public:
-    hw_brightness_cache(void)
-        : cache<T>(HW_BRIGHTNESS_CACHE)
-    {
-    }
-};
+using hw_brightness_cache = level_cache<T, state_file::hw_brightness>;
 
 }; // namespace fs
 
@@ -6,7 +6,9 @@
 #include <optional>
 #include <tuple>
 
+#ifndef CACHE_PREFIX
 #define CACHE_PREFIX "/var/cache/system76-kbd-led/"
+#endif
 
 namespace fs
 {
@@ -0,0 +1,906 @@
+#include "cli.hpp"
+#include "app.hpp"
+#include "args.hpp"
+#include "audio.hpp"
+#include "color/hex.hpp"
+#include "color/space.hpp"
+#include "device.hpp"
+#include "effects.hpp"
+#include "http.hpp"
+#include "idle.hpp"
+#include "ipc.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "schedule.hpp"
+#include "signals.hpp"
+#include "timeline.hpp"
+#include "watcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <poll.h>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Local aliases, structs, and function declarations.
+#define USAGE_LINE                                                            \
+    " [-h,--help] [-v,--verbose] [-q,--quiet] [-d,--daemon] "                 \
+    "[-n,--no-daemon] [--http <arg> [--http-root <arg>]] [-t,--toggle] "      \
+    "[-x,--restore] [-l,--left <arg>] [-c,--center <arg>] "                   \
+    "[-r,--right <arg>] [-e,--extra <arg>] [--hsv] "                          \
+    "[--gradient <arg> [--blend <arg>]] [-b,--brightness <arg>] "             \
+    "[-i,--increment <arg>] [-p,--profile <arg>] [--save-profile <arg>] "     \
+    "[--delete-profile <arg>] [--list-profiles] [--device <arg>] [-a,--all] " \
+    "[--list-devices] [--layout <arg>] [--track-hw] [--watch] "               \
+    "[--fade-ms <arg>] [--effect <arg> [--period <arg>] [--fps <arg>] "       \
+    "[--duration <arg>]] [--audio <arg> [--audio-rate <arg>] "                \
+    "[--audio-channels <arg>]] [--show <arg> [--compile-show <arg>]] "        \
+    "[--schedule <arg>] [--idle <arg> [--idle-level <arg>] "                 \
+    "[--idle-input <arg>]] [--io-uring] [--stats <arg>] "                     \
+    "[--metrics-file <arg>]"
+
+// Every option, described at compile time.
+static constexpr args::option options[] = {
+    {"help", 'h', args::kind::flag, "Display the help message."},
+    {"verbose", 'v', args::kind::flag, "Enable debug logging."},
+    {"quiet", 'q', args::kind::flag, "Don't print the resulting colors."},
+    {"daemon", 'd', args::kind::flag, "Serve requests on " SOCKET_PATH "."},
+    {"no-daemon", 'n', args::kind::flag,
+     "Don't forward to a running daemon."},
+    {"http", '\0', args::kind::string,
+     "Serve the web API over HTTP on [address:]port (default address: "
+     "127.0.0.1)."},
+    {"http-root", '\0', args::kind::string,
+     "Also serve the web UI's files from this directory with --http."},
+    {"toggle", 't', args::kind::flag, "Toggle keyboard."},
+    {"restore", 'x', args::kind::flag, "Restore colors and brightness."},
+    {"left", 'l', args::kind::string, "Left color (rgb)."},
+    {"center", 'c', args::kind::string, "Center color (rgb)."},
+    {"right", 'r', args::kind::string, "Right color (rgb)."},
+    {"extra", 'e', args::kind::string, "Extra color (rgb)."},
+    {"hsv", '\0', args::kind::flag,
+     "Read colors as H,S,V: hue in degrees, saturation and value in "
+     "percent."},
+    {"gradient", '\0', args::kind::string,
+     "Color the regions with a gradient through colon-separated colors, "
+     "e.g. ff0000:0000ff."},
+    {"blend", '\0', args::kind::string,
+     "Where --gradient mixes: srgb, linear, hsv, hsl or oklab.", "oklab"},
+    {"brightness", 'b', args::kind::integer, "Brightness overriding value."},
+    {"increment", 'i', args::kind::integer, "Brightness increment (-/+)."},
+    {"profile", 'p', args::kind::string, "Apply a saved profile."},
+    {"save-profile", '\0', args::kind::string,
+     "Save the resulting colors and brightness as a profile."},
+    {"delete-profile", '\0', args::kind::string, "Delete a profile."},
+    {"list-profiles", '\0', args::kind::flag, "List saved profiles."},
+    {"device", '\0', args::kind::string,
+     "Operate on the named LED device instead of the default one."},
+    {"all", 'a', args::kind::flag,
+     "Apply to every System76 keyboard found, concurrently."},
+    {"list-devices", '\0', args::kind::flag, "List System76 keyboards."},
+    {"layout", '\0', args::kind::string,
+     "Zone layout: four-zone, single-zone, multicolor or a layout file "
+     "(default: detected)."},
+    {"track-hw", '\0', args::kind::flag,
+     "Keep the brightness caches in sync with the Fn keys until "
+     "interrupted."},
+    {"watch", '\0', args::kind::flag,
+     "Print a JSON line for every change to colors or brightness until "
+     "interrupted."},
+    {"fade-ms", '\0', args::kind::unsigned_integer,
+     "Fade brightness changes over this many milliseconds."},
+    {"effect", '\0', args::kind::string,
+     "Play an effect: breathing, rainbow, wave or strobe."},
+    {"period", '\0', args::kind::real, "Effect cycle length in seconds.",
+     "2"},
+    {"fps", '\0', args::kind::unsigned_integer,
+     "Effect, audio and show frames per second.", "30"},
+    {"duration", '\0', args::kind::real,
+     "Effect duration in seconds (0: until interrupted).", "0"},
+    {"audio", '\0', args::kind::string,
+     "React to s16le PCM or WAV audio read from a file or FIFO (- for "
+     "stdin)."},
+    {"audio-rate", '\0', args::kind::unsigned_integer,
+     "Sample rate of raw --audio input.", "44100"},
+    {"audio-channels", '\0', args::kind::unsigned_integer,
+     "Channel count of raw --audio input.", "2"},
+    {"show", '\0', args::kind::string, "Play a compiled timeline."},
+    {"compile-show", '\0', args::kind::string,
+     "Compile a text timeline into the --show file instead of playing it."},
+    {"schedule", '\0', args::kind::string,
+     "Follow the time-of-day rules in this file until interrupted."},
+    {"idle", '\0', args::kind::real,
+     "Dim the keyboard after this many seconds without input, until "
+     "interrupted."},
+    {"idle-level", '\0', args::kind::unsigned_integer,
+     "Brightness to dim to with --idle.", "0"},
+    {"idle-input", '\0', args::kind::string,
+     "Read input events from this FIFO (- for stdin) instead of "
+     INPUT_PREFIX "event*."},
+    {"io-uring", '\0', args::kind::flag,
+     "Submit daemon and effect writes through io_uring when available."},
+    {"stats", '\0', args::kind::string,
+     "Print I/O counters and latencies to stderr on exit: human or json."},
+    {"metrics-file", '\0', args::kind::string,
+     "Keep Prometheus metrics in this file, rewritten every 10 seconds."},
+};
+
+using variables = args::variables<std::size(options)>;
+
+// Shortest effect period, in seconds; shorter ones only alias at any
+// frame rate, and vanishing ones divide time into infinity.
+static constexpr double min_period = 0.001;
+
+// Longest span in seconds a time option takes: what fits in a uint32_t
+// of milliseconds, like a timeline keyframe.
+static constexpr double max_seconds =
+    std::numeric_limits<uint32_t>::max() / 1000.0;
+
+static int print_help(const std::string &usage, const variables &vm,
+                      int rc = 0);
+static int print_error(const std::string &error, int rc = 1);
+static fs::batch::backend io_backend(const variables &vm);
+static bool parse_color(std::string_view s, bool hsv, color::rgb &out);
+static int run_command(const variables &vm);
+static int run_effect(const variables &vm, effects::kind k,
+                      app::state &st);
+static int run_audio(const variables &vm, app::state &st);
+static int run_show(const variables &vm, const timeline::show &show,
+                    app::state &st);
+static int run_schedule(const schedule::plan &plan, app::state &st);
+static int run_idle(const variables &vm, std::deque<app::state> &states);
+static int run_track_hw(const std::vector<led::device> &devices,
+                        std::deque<app::state> &states);
+static int run_watch(const std::vector<led::device> &devices,
+                     std::deque<app::state> &states);
+static int manage_profiles(const variables &vm);
+
+// Call fn(0) through fn(n - 1) concurrently, the last on this thread.
+template <typename Fn>
+static void parallel(std::size_t n, Fn &&fn)
+{
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i + 1 < n; ++i)
+        threads.emplace_back(fn, i);
+    if (n)
+        fn(n - 1);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+int cli::run(int argc, char *argv[])
+{
+    variables vm(options);
+
+    // Prepare usage line.
+    std::string usage(argv[0]);
+    usage.append(USAGE_LINE);
+
+    try {
+        vm.parse(argc, argv);
+    } catch (args::error &e) {
+        print_error(e.what());
+        return print_help(usage, vm, 1);
+    }
+
+    if (vm.count("help"))
+        return print_help(usage, vm);
+
+    logging::set_debug(vm.count("verbose"));
+
+    std::string stats;
+    if (vm.count("stats")) {
+        stats = vm.at("stats").as<std::string>();
+        if (stats != "human" && stats != "json")
+            return print_error("--stats must be human or json.");
+    }
+
+    int rc;
+    {
+        // Long-running modes keep the file fresh; it's written once more
+        // with the final figures when the command is done.
+        std::optional<metrics::exporter> exporter;
+        if (vm.count("metrics-file"))
+            exporter.emplace(vm.at("metrics-file").as<std::string>());
+        rc = run_command(vm);
+    }
+
+    if (stats == "human")
+        metrics::print(std::cerr);
+    else if (stats == "json")
+        metrics::print_json(std::cerr);
+    return rc;
+}
+
+static int run_command(const variables &vm)
+{
+    if (vm.count("daemon"))
+        return ipc::serve(SOCKET_PATH, io_backend(vm));
+    if (vm.count("http")) {
+        std::string root;
+        if (vm.count("http-root"))
+            root = vm.at("http-root").as<std::string>();
+        return http::serve(vm.at("http").as<std::string>(), root,
+                           io_backend(vm));
+    }
+
+    if (vm.count("list-profiles") || vm.count("delete-profile"))
+        return manage_profiles(vm);
+
+    if (vm.count("list-devices")) {
+        for (auto &dev : led::discover())
+            std::cout << dev.name << '\n';
+        return 0;
+    }
+
+    app::request req;
+
+    // A profile is applied like its colors and brightness were given on
+    // the command line; explicit flags below override it.
+    if (vm.count("profile")) {
+        auto name = vm.at("profile").as<std::string>();
+        std::optional<fs::profile> p;
+        try {
+            p = fs::profile_store().find(name);
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+        if (!p)
+            return print_error("no profile named '" + name + "'.");
+
+        for (std::size_t i = 0; i < p->colors.size(); ++i)
+            color::hex::encode(req.colors[i], p->colors[i].value());
+        req.flags |= app::request::left | app::request::center |
+                     app::request::right | app::request::extra |
+                     app::request::brightness;
+        req.level = p->brightness;
+    }
+
+    if (vm.count("toggle"))
+        req.flags |= app::request::toggle;
+    if (vm.count("restore"))
+        req.flags |= app::request::restore;
+
+    // A gradient colors every region; explicit colors below override it.
+    const bool hsv = vm.count("hsv");
+    if (vm.count("gradient")) {
+        auto name = vm.at("blend").as<std::string>();
+        auto blend = color::parse_space(name);
+        if (!blend)
+            return print_error("unknown --blend space '" + name + "'.");
+
+        std::vector<color::rgb> stops;
+        auto value = vm.at("gradient").as<std::string>();
+        std::string_view list = value;
+        for (std::size_t pos = 0; pos <= list.size();) {
+            auto end = std::min(list.find(':', pos), list.size());
+            auto stop = list.substr(pos, end - pos);
+            if (!parse_color(stop, hsv, stops.emplace_back()))
+                return print_error("invalid gradient color '" +
+                                   std::string(stop) + "'.");
+            pos = end + 1;
+        }
+
+        color::buffer regions(4);
+        color::gradient(stops.data(), stops.size(), *blend, regions);
+        for (std::size_t i = 0; i < regions.size(); ++i)
+            color::hex::encode(req.colors[i], regions.get(i).value());
+        req.flags |= app::request::left | app::request::center |
+                     app::request::right | app::request::extra;
+    }
+
+    // Colors are forwarded as hex; whoever applies the request parses
+    // them.
+    const std::pair<const char *, app::request::flag> regions[] = {
+        {"left", app::request::left},
+        {"center", app::request::center},
+        {"right", app::request::right},
+        {"extra", app::request::extra}};
+    for (std::size_t i = 0; i < 4; ++i) {
+        auto [name, flag] = regions[i];
+        if (!vm.count(name))
+            continue;
+        auto value = vm.at(name).as<std::string>();
+        color::rgb c;
+        if (!parse_color(value, hsv, c))
+            return print_error(std::string("invalid ") + name + " color '" +
+                               value + "'.");
+        color::hex::encode(req.colors[i], c.value());
+        req.flags |= flag;
+    }
+
+    if (vm.count("brightness")) {
+        req.flags |= app::request::brightness;
+        req.level = vm.at("brightness").as<int>();
+    }
+
+    if (vm.count("increment")) {
+        req.flags |= app::request::increment;
+        req.delta = vm.at("increment").as<int>();
+    }
+
+    // Saving a profile needs the resulting state even when it isn't
+    // printed. --watch prints nothing but its JSON lines.
+    if ((vm.count("quiet") || vm.count("watch")) &&
+        !vm.count("save-profile"))
+        req.flags |= app::request::quiet;
+
+    if (vm.count("fade-ms"))
+        req.fade_ms = vm.at("fade-ms").as<unsigned>();
+
+    std::optional<effects::kind> effect;
+    if (vm.count("effect")) {
+        auto name = vm.at("effect").as<std::string>();
+        if (!(effect = effects::parse(name)))
+            return print_error("unknown effect '" + name + "'.");
+        if (vm.at("period").as<double>() < min_period ||
+            !vm.at("fps").as<unsigned>())
+            return print_error(
+                "--period must be at least 0.001 and --fps positive.");
+        auto duration = vm.at("duration").as<double>();
+        if (duration < 0.0 || duration > max_seconds)
+            return print_error("--duration must be between 0 and " +
+                               std::to_string(uint32_t(max_seconds)) +
+                               " seconds.");
+    }
+
+    const bool audio = vm.count("audio");
+    if (audio) {
+        if (effect)
+            return print_error("--effect and --audio can't be combined.");
+        if (!vm.at("fps").as<unsigned>() ||
+            !vm.at("audio-rate").as<unsigned>() ||
+            !vm.at("audio-channels").as<unsigned>()) {
+            return print_error(
+                "--fps, --audio-rate and --audio-channels must be positive.");
+        }
+    }
+
+    // Compiling doesn't touch the keyboard; playing maps the show up
+    // front so a bad file is reported before anything changes.
+    std::optional<timeline::show> show;
+    if (vm.count("compile-show") || vm.count("show")) {
+        if (!vm.count("show"))
+            return print_error("--compile-show needs a --show file.");
+        if (effect || audio)
+            return print_error("--show can't be combined with --effect or "
+                               "--audio.");
+        if (!vm.at("fps").as<unsigned>())
+            return print_error("--fps must be positive.");
+        try {
+            auto path = vm.at("show").as<std::string>();
+            if (vm.count("compile-show")) {
+                timeline::compile(vm.at("compile-show").as<std::string>(),
+                                  path);
+                return 0;
+            }
+            show.emplace(path);
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+    }
+
+    // Like a show, the schedule is loaded before anything changes.
+    std::optional<schedule::plan> plan;
+    if (vm.count("schedule")) {
+        if (effect || audio || show)
+            return print_error("--schedule can't be combined with --effect, "
+                               "--audio or --show.");
+        try {
+            plan = schedule::load(vm.at("schedule").as<std::string>(),
+                                  fs::profile_store());
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+    }
+
+    const bool idling = vm.count("idle");
+    if (idling) {
+        if (effect || audio || show || plan)
+            return print_error("--idle can't be combined with --effect, "
+                               "--audio, --show or --schedule.");
+        auto seconds = vm.at("idle").as<double>();
+        if (seconds <= 0.0 || seconds > max_seconds)
+            return print_error("--idle must be positive and at most " +
+                               std::to_string(uint32_t(max_seconds)) +
+                               " seconds.");
+    }
+
+    // Without --all or --device, only the default device is driven.
+    std::vector<led::device> devices;
+    if (vm.count("all")) {
+        devices = led::discover();
+        if (devices.empty())
+            return print_error("no keyboards found in " LEDS_PREFIX ".");
+    } else if (vm.count("device")) {
+        auto name = vm.at("device").as<std::string>();
+        auto dev = led::find_device(name);
+        if (!dev)
+            return print_error("no LED device named '" + name + "'.");
+        devices.push_back(*dev);
+    }
+
+    // A layout given by name or file overrides detection.
+    std::optional<color::layout> layout;
+    if (vm.count("layout")) {
+        auto name = vm.at("layout").as<std::string>();
+        try {
+            auto builtin = color::find_layout(name);
+            layout = builtin ? *builtin : color::load_layout(name);
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+    }
+
+    // Prefer a running daemon; it already holds all of the state below.
+    // Long-running modes and other devices are driven from here, though.
+    std::vector<app::response> results(1);
+    std::vector<std::string> errors(1);
+    std::deque<app::state> states;
+    bool forwarded = false;
+    bool tracking = vm.count("track-hw");
+    bool watching = vm.count("watch");
+    if (!vm.count("no-daemon") && devices.empty() && !layout && !effect &&
+        !audio && !show && !plan && !idling && !tracking && !watching) {
+        try {
+            forwarded = ipc::send(SOCKET_PATH, req, results[0]);
+        } catch (std::system_error &e) {
+            return print_error(e.what());
+        }
+    }
+
+    if (forwarded) {
+        logging::debug("Request handled by daemon at", SOCKET_PATH);
+    } else {
+        if (!app::ensure_cache_dir())
+            return print_error("mkdir() failed on: " CACHE_PREFIX);
+
+        if (devices.empty())
+            devices.push_back(led::default_device());
+
+        try {
+            for (auto &dev : devices) {
+                if (layout)
+                    states.emplace_back(dev, *layout);
+                else
+                    states.emplace_back(dev);
+            }
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+
+        // Each device is its own EC round trips; do them all at once.
+        results.resize(devices.size());
+        errors.resize(devices.size());
+        parallel(devices.size(), [&](std::size_t i) {
+            try {
+                results[i] = app::run(states[i], req);
+                states[i].cache.file.flush();
+            } catch (std::exception &e) {
+                errors[i] = e.what();
+            }
+        });
+    }
+
+    int rc = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        auto &res = results[i];
+        std::string label;
+        if (devices.size() > 1) {
+            label = devices[i].name + ": ";
+            if (!req.has(app::request::quiet))
+                std::cout << devices[i].name << ':' << std::endl;
+        }
+
+        if (!errors[i].empty()) {
+            rc = print_error(label + errors[i]);
+            continue;
+        }
+        if (res.status) {
+            rc = print_error(label + res.error, res.status);
+            continue;
+        }
+
+        if (!req.has(app::request::quiet)) {
+            for (auto &color : res.colors)
+                std::cout.write(color, sizeof(color)) << std::endl;
+
+            logging::debug("Brightness: { level:", res.level,
+                           ", max_level:", res.max_level,
+                           ", hw_level:", res.hw_level, " }");
+        }
+        logging::debug("Writes: { written:", res.written,
+                       ", skipped:", res.skipped, " }");
+    }
+    if (rc)
+        return rc;
+
+    // With several devices, the first one's result is saved.
+    if (vm.count("save-profile")) {
+        auto &res = results.front();
+        fs::profile p;
+        for (std::size_t i = 0; i < p.colors.size(); ++i)
+            p.colors[i] = color::rgb(std::string_view(res.colors[i], 6));
+        p.brightness = res.level;
+        try {
+            if (!app::ensure_data_dir())
+                return print_error("mkdir() failed on: " DATA_PREFIX);
+            fs::profile_store(PROFILES_PATH, true)
+                .save(vm.at("save-profile").as<std::string>(), p);
+        } catch (std::exception &e) {
+            return print_error(e.what());
+        }
+    }
+
+    if (effect) {
+        std::vector<int> rcs(states.size());
+        parallel(states.size(), [&](std::size_t i) {
+            rcs[i] = run_effect(vm, *effect, states[i]);
+        });
+        return *std::max_element(rcs.begin(), rcs.end());
+    }
+    if (audio) {
+        if (states.size() > 1)
+            return print_error("--audio drives a single device.");
+        return run_audio(vm, states.front());
+    }
+    if (show) {
+        std::vector<int> rcs(states.size());
+        parallel(states.size(), [&](std::size_t i) {
+            rcs[i] = run_show(vm, *show, states[i]);
+        });
+        return *std::max_element(rcs.begin(), rcs.end());
+    }
+    if (plan) {
+        std::vector<int> rcs(states.size());
+        parallel(states.size(), [&](std::size_t i) {
+            rcs[i] = run_schedule(*plan, states[i]);
+        });
+        return *std::max_element(rcs.begin(), rcs.end());
+    }
+    if (idling)
+        return run_idle(vm, states);
+    if (tracking)
+        return run_track_hw(devices, states);
+    if (watching)
+        return run_watch(devices, states);
+    return 0;
+}
+
+static int manage_profiles(const variables &vm)
+{
+    try {
+        if (vm.count("delete-profile")) {
+            // Look first, so a missing store isn't created just to find
+            // nothing in it.
+            auto name = vm.at("delete-profile").as<std::string>();
+            if (!fs::profile_store().find(name) ||
+                !fs::profile_store(PROFILES_PATH, true).remove(name))
+                return print_error("no profile named '" + name + "'.");
+        }
+
+        if (vm.count("list-profiles")) {
+            for (auto &name : fs::profile_store().list())
+                std::cout << name << '\n';
+        }
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+static int run_track_hw(const std::vector<led::device> &devices,
+                        std::deque<app::state> &states)
+{
+    try {
+        // One poll set covers every device's brightness_hw_changed.
+        std::vector<led::hw_watcher> watchers;
+        std::vector<pollfd> fds;
+        for (auto &dev : devices) {
+            watchers.emplace_back(dev.path);
+            fds.push_back({watchers.back().fd(), POLLPRI | POLLERR, 0});
+        }
+
+        signals::install();
+        while (signals::running()) {
+            if (poll(fds.data(), fds.size(), -1) == -1)
+                continue;
+
+            for (std::size_t i = 0; i < fds.size(); ++i) {
+                if (!fds[i].revents)
+                    continue;
+                if (auto level = watchers[i].consume()) {
+                    app::on_hw_changed(states[i], *level);
+                    states[i].cache.file.flush();
+                }
+            }
+        }
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+// What --watch reports of a device.
+struct snapshot {
+    color::buffer colors;
+    uint32_t level = 0;
+    uint32_t hw_level = 0;
+};
+
+static snapshot read_snapshot(app::state &st)
+{
+    st.kb.forget();
+    st.brightness.reload();
+    return {st.kb.colors(), st.brightness.level(), st.brightness.hw_level()};
+}
+
+// The fields of now that differ from last, as a JSON object; empty if
+// nothing does.
+static std::string delta(const led::device &dev, bool named,
+                         const color::keyboard &kb, const snapshot &now,
+                         const std::optional<snapshot> &last)
+{
+    std::string fields;
+    auto add = [&](std::string_view key, const std::string &value) {
+        fields += fields.empty() ? "\"" : ",\"";
+        fields.append(key.data(), key.size());
+        fields += "\":";
+        fields += value;
+    };
+
+    auto &zones = kb.layout().zones();
+    for (std::size_t i = 0; i < now.colors.size(); ++i) {
+        auto c = now.colors.get(i);
+        if (!last || last->colors.get(i) != c)
+            add(zones[i].name, '"' + std::to_string(c) + '"');
+    }
+    if (!last || last->level != now.level)
+        add("brightness", std::to_string(now.level));
+    if (!last || last->hw_level != now.hw_level)
+        add("hw_brightness", std::to_string(now.hw_level));
+
+    if (fields.empty())
+        return fields;
+    if (named)
+        return "{\"device\":\"" + dev.name + "\"," + fields + "}";
+    return "{" + fields + "}";
+}
+
+static int run_watch(const std::vector<led::device> &devices,
+                     std::deque<app::state> &states)
+{
+    try {
+        led::change_watcher watcher(CACHE_PREFIX);
+        for (std::size_t i = 0; i < devices.size(); ++i) {
+            auto &dir = devices[i].path;
+            watcher.add(dir + BRIGHTNESS_FILE);
+            for (auto &zone : states[i].kb.layout().zones())
+                watcher.add(zone.path(dir));
+            try {
+                watcher.add(dir + HW_BRIGHTNESS_FILE, true);
+            } catch (std::system_error &) {
+                // Missing on older kernels.
+            }
+        }
+
+        // The first round reports everything, every later one only
+        // what changed.
+        std::vector<std::optional<snapshot>> last(states.size());
+        signals::install();
+        do {
+            for (std::size_t i = 0; i < states.size(); ++i) {
+                snapshot now;
+                try {
+                    now = read_snapshot(states[i]);
+                } catch (std::system_error &) {
+                    // Caught mid-write; the write's own event follows.
+                    continue;
+                }
+
+                auto line = delta(devices[i], devices.size() > 1,
+                                  states[i].kb, now, last[i]);
+                if (!line.empty())
+                    std::cout << line << std::endl;
+                last[i] = std::move(now);
+            }
+        } while (std::cout && watcher.wait() && signals::running());
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+// Six hex digits, or with --hsv "H,S,V": hue in degrees, saturation and
+// value in percent.
+static bool parse_color(std::string_view s, bool hsv, color::rgb &out)
+{
+    if (!hsv) {
+        auto value = color::hex::decode(s);
+        if (value)
+            out = color::rgb(*value);
+        return value.has_value();
+    }
+
+    double parts[3];
+    for (std::size_t i = 0; i < 3; ++i) {
+        auto comma = s.find(',');
+        if ((i < 2) != (comma != std::string_view::npos) ||
+            !args::to_real(s.substr(0, comma), parts[i]))
+            return false;
+        s.remove_prefix(i < 2 ? comma + 1 : s.size());
+    }
+    if (parts[1] < 0.0 || parts[1] > 100.0 || parts[2] < 0.0 ||
+        parts[2] > 100.0)
+        return false;
+
+    // Wrapped here, so hues beyond float's range stay finite.
+    out = color::from_hsv({float(std::fmod(parts[0], 360.0)),
+                           float(parts[1] / 100.0), float(parts[2] / 100.0)});
+    return true;
+}
+
+// Only long-lived writers (the daemon, the HTTP server, effects) honour
+// --io-uring; a one-shot writes too little to make setting up a ring
+// worth it.
+static fs::batch::backend io_backend(const variables &vm)
+{
+    return vm.count("io-uring") ? fs::batch::backend::automatic
+                                : fs::batch::backend::pwrite;
+}
+
+// Animate around the current colors and level, or the last level we
+// knew of when the keyboard is off.
+static effects::params base_params(const variables &vm, app::state &st)
+{
+    effects::params p;
+    p.colors = st.kb.colors();
+    p.period = vm.at("period").as<double>();
+
+    p.level = st.brightness.level();
+    if (!p.level)
+        p.level = st.cache.brightness.data().value_or(
+            st.brightness.max_level());
+    return p;
+}
+
+static int run_effect(const variables &vm, effects::kind k, app::state &st)
+{
+    st.batch.select(io_backend(vm));
+    try {
+        auto p = base_params(vm, st);
+        effects::engine engine(st.kb, st.brightness, st.batch);
+        auto stats = engine.run(k, p, vm.at("fps").as<unsigned>(),
+                                vm.at("duration").as<double>());
+        logging::debug("Effect: { frames:", stats.frames,
+                       ", dropped:", stats.dropped,
+                       ", unchanged:", stats.unchanged,
+                       ", written:", stats.writes.written,
+                       ", skipped:", stats.writes.skipped, " }");
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+static int run_audio(const variables &vm, app::state &st)
+{
+    auto path = vm.at("audio").as<std::string>();
+    int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return print_error(path + ": " + strerror(errno) + ".");
+
+    audio::format fmt;
+    fmt.rate = vm.at("audio-rate").as<unsigned>();
+    fmt.channels = vm.at("audio-channels").as<unsigned>();
+
+    st.batch.select(io_backend(vm));
+    int rc = 0;
+    try {
+        auto p = base_params(vm, st);
+        audio::reader in(fd, fmt);
+        audio::visualizer vis(st.kb, st.brightness, st.batch);
+        auto stats = vis.run(in, p, vm.at("fps").as<unsigned>());
+        logging::debug("Audio: { frames:", stats.frames,
+                       ", dropped:", stats.dropped,
+                       ", unchanged:", stats.unchanged,
+                       ", written:", stats.writes.written,
+                       ", skipped:", stats.writes.skipped, " }");
+    } catch (std::exception &e) {
+        rc = print_error(e.what());
+    }
+
+    if (fd != STDIN_FILENO)
+        ::close(fd);
+    return rc;
+}
+
+static int run_show(const variables &vm, const timeline::show &show,
+                    app::state &st)
+{
+    st.batch.select(io_backend(vm));
+    try {
+        auto p = base_params(vm, st);
+        timeline::player player(st.kb, st.brightness, st.batch);
+        auto stats = player.run(show, p, vm.at("fps").as<unsigned>());
+        logging::debug("Show: { frames:", stats.frames,
+                       ", dropped:", stats.dropped,
+                       ", unchanged:", stats.unchanged,
+                       ", written:", stats.writes.written,
+                       ", skipped:", stats.writes.skipped, " }");
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+static int run_schedule(const schedule::plan &plan, app::state &st)
+{
+    try {
+        auto transitions = schedule::run(plan, st);
+        logging::debug("Schedule: { transitions:", transitions, " }");
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+// Every device dims together: input anywhere keeps them all on.
+static int run_idle(const variables &vm, std::deque<app::state> &states)
+{
+    idle::config c;
+    c.timeout = std::chrono::milliseconds(
+        std::lround(vm.at("idle").as<double>() * 1000));
+    c.level = vm.at("idle-level").as<unsigned>();
+    if (vm.count("fade-ms"))
+        c.fade = std::chrono::milliseconds(vm.at("fade-ms").as<unsigned>());
+
+    try {
+        idle::monitor monitor;
+        if (vm.count("idle-input")) {
+            auto path = vm.at("idle-input").as<std::string>();
+            if (path == "-")
+                monitor.add(STDIN_FILENO, false);
+            else
+                monitor.open(path);
+        } else {
+            for (auto &path : idle::discover())
+                monitor.open(path);
+            if (!monitor.size())
+                return print_error("no readable keyboards or pointers in "
+                                   INPUT_PREFIX ".");
+        }
+
+        auto stats = monitor.run(states, c);
+        logging::debug("Idle: { events:", stats.events,
+                       ", dims:", stats.dims,
+                       ", restores:", stats.restores, " }");
+        for (auto &st : states)
+            st.cache.file.flush();
+    } catch (std::exception &e) {
+        return print_error(e.what());
+    }
+    return 0;
+}
+
+static int print_help(const std::string &usage, const variables &vm, int rc)
+{
+    std::cout << "usage: " << usage << "\n\n"
+              << vm.help("Program options") << std::endl;
+    return rc;
+}
+
+static int print_error(const std::string &error, int rc)
+{
+    std::cerr << "error: " << error << std::endl;
+    return rc;
+}
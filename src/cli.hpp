@@ -0,0 +1,21 @@
+#ifndef CLI_HPP
+#define CLI_HPP
+
+namespace cli
+{
+
+/**
+ * @brief Parse the command line and carry it out.
+ *
+ * This is everything main() does, kept apart from main() so that other
+ * entry points (the benchmark) can drive the exact same code path.
+ *
+ * @param argc Argument count, as given to main().
+ * @param argv Argument vector, as given to main().
+ * @returns Process exit code.
+ **/
+int run(int argc, char *argv[]);
+
+}; // namespace cli
+
+#endif /* CLI_HPP */
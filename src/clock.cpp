@@ -0,0 +1,68 @@
+#include "clock.hpp"
+#include <cerrno>
+#include <ctime>
+#include <sys/timerfd.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace timing;
+
+frame_clock::frame_clock(unsigned fps)
+    : m_period(std::chrono::nanoseconds(1000000000ull / (fps ? fps : 1)))
+{
+    m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (m_fd == -1)
+        throw std::system_error(errno, std::generic_category(),
+                                "timerfd_create");
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    itimerspec spec{};
+    spec.it_value = now;
+    spec.it_interval.tv_sec = m_period.count() / 1000000000;
+    spec.it_interval.tv_nsec = m_period.count() % 1000000000;
+    if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        int error = errno;
+        close(m_fd);
+        throw std::system_error(error, std::generic_category(),
+                                "timerfd_settime");
+    }
+}
+
+frame_clock::~frame_clock(void)
+{
+    close(m_fd);
+}
+
+uint64_t frame_clock::wait(void)
+{
+    uint64_t expirations = 0;
+    if (read(m_fd, &expirations, sizeof(expirations)) !=
+        sizeof(expirations))
+        return 0;
+
+    // The first expiration is frame 0 itself.
+    if (!m_started) {
+        m_started = true;
+        m_frame = expirations - 1;
+        return expirations;
+    }
+    m_frame += expirations;
+    return expirations;
+}
+
+uint64_t frame_clock::frame(void) const
+{
+    return m_frame;
+}
+
+std::chrono::nanoseconds frame_clock::elapsed(void) const
+{
+    return m_period * m_frame;
+}
+
+int frame_clock::fd(void) const
+{
+    return m_fd;
+}
@@ -0,0 +1,58 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace timing
+{
+
+/**
+ * @brief A fixed-rate frame clock backed by a CLOCK_MONOTONIC timerfd.
+ *
+ * The timer is armed once with an absolute start time and a periodic
+ * interval, so the kernel keeps the schedule: frame n always fires at
+ * start + n * period, no matter how late the caller was for frame n - 1.
+ * Frames the caller was too slow to see are reported, not replayed.
+ **/
+class frame_clock
+{
+private:
+    int m_fd = -1;
+    std::chrono::nanoseconds m_period;
+    uint64_t m_frame = 0;
+    bool m_started = false;
+
+public:
+    /**
+     * @brief Start ticking at fps frames per second.
+     *
+     * @throws std::system_error if the timerfd can't be created.
+     **/
+    explicit frame_clock(unsigned fps);
+    ~frame_clock(void);
+
+    frame_clock(const frame_clock &) = delete;
+    frame_clock &operator=(const frame_clock &) = delete;
+
+    /**
+     * @brief Block until the next frame is due.
+     *
+     * @returns Number of frames that elapsed since the last call; more
+     *          than one means frames were dropped. Zero if the wait was
+     *          interrupted by a signal.
+     **/
+    uint64_t wait(void);
+
+    // Index of the current frame, counting dropped ones.
+    uint64_t frame(void) const;
+
+    // Time of the current frame relative to the clock's start.
+    std::chrono::nanoseconds elapsed(void) const;
+
+    int fd(void) const;
+};
+
+}; // namespace timing
+
+#endif /* CLOCK_HPP */
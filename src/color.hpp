@@ -1,7 +1,8 @@
 #ifndef COLOR_HPP
 #define COLOR_HPP
 
-#include "color/region.hpp"
+#include "color/buffer.hpp"
+#include "color/layout.hpp"
 #include "color/rgb.hpp"
 
 #endif
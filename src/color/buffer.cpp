@@ -0,0 +1,85 @@
+#include "buffer.hpp"
+#include <algorithm>
+using namespace color;
+
+buffer::buffer(std::size_t size)
+    : m_size(size)
+    , m_planes(size * 3)
+{
+}
+
+std::size_t buffer::size(void) const
+{
+    return m_size;
+}
+
+void buffer::resize(std::size_t size)
+{
+    // Planes are laid out back to back, so each one moves.
+    std::vector<uint8_t> planes(size * 3);
+    std::size_t n = std::min(size, m_size);
+    for (std::size_t p = 0; p < 3; ++p)
+        std::copy_n(m_planes.data() + p * m_size, n,
+                    planes.data() + p * size);
+    m_planes.swap(planes);
+    m_size = size;
+}
+
+uint8_t *buffer::r(void)
+{
+    return m_planes.data();
+}
+
+uint8_t *buffer::g(void)
+{
+    return m_planes.data() + m_size;
+}
+
+uint8_t *buffer::b(void)
+{
+    return m_planes.data() + 2 * m_size;
+}
+
+const uint8_t *buffer::r(void) const
+{
+    return m_planes.data();
+}
+
+const uint8_t *buffer::g(void) const
+{
+    return m_planes.data() + m_size;
+}
+
+const uint8_t *buffer::b(void) const
+{
+    return m_planes.data() + 2 * m_size;
+}
+
+rgb buffer::get(std::size_t i) const
+{
+    return rgb((uint32_t(r()[i]) << 16) | (uint32_t(g()[i]) << 8) | b()[i]);
+}
+
+void buffer::set(std::size_t i, const rgb &color)
+{
+    r()[i] = color.red();
+    g()[i] = color.green();
+    b()[i] = color.blue();
+}
+
+void buffer::fill(const rgb &color)
+{
+    std::fill_n(r(), m_size, color.red());
+    std::fill_n(g(), m_size, color.green());
+    std::fill_n(b(), m_size, color.blue());
+}
+
+bool buffer::operator==(const buffer &other) const
+{
+    return m_size == other.m_size && m_planes == other.m_planes;
+}
+
+bool buffer::operator!=(const buffer &other) const
+{
+    return !(*this == other);
+}
@@ -0,0 +1,54 @@
+#ifndef COLOR_BUFFER_HPP
+#define COLOR_BUFFER_HPP
+
+#include "rgb.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace color
+{
+
+/**
+ * @brief A run of colors stored as separate red, green and blue planes.
+ *
+ * All three planes live in one contiguous allocation, so a loop over
+ * hundreds of keys touches plain uint8_t arrays the compiler can
+ * vectorize, rather than striding over packed rgb values.
+ **/
+class buffer
+{
+private:
+    std::size_t m_size = 0;
+    std::vector<uint8_t> m_planes;
+
+public:
+    buffer(void) = default;
+    explicit buffer(std::size_t size);
+
+    std::size_t size(void) const;
+
+    // Change the number of colors; new ones are black.
+    void resize(std::size_t size);
+
+    // Plane pointers, each size() bytes long.
+    uint8_t *r(void);
+    uint8_t *g(void);
+    uint8_t *b(void);
+    const uint8_t *r(void) const;
+    const uint8_t *g(void) const;
+    const uint8_t *b(void) const;
+
+    rgb get(std::size_t i) const;
+    void set(std::size_t i, const rgb &color);
+
+    // Set every color to color.
+    void fill(const rgb &color);
+
+    bool operator==(const buffer &other) const;
+    bool operator!=(const buffer &other) const;
+};
+
+}; // namespace color
+
+#endif /* COLOR_BUFFER_HPP */
@@ -0,0 +1,84 @@
+#include "hex.hpp"
+#include <cstring>
+
+namespace
+{
+
+constexpr uint64_t ones = 0x0101010101010101ull;
+constexpr uint64_t high = 0x8080808080808080ull;
+
+// Load eight characters so that the first one is the lowest byte.
+inline uint64_t load(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// High bit of each byte set where lo <= byte <= hi; bytes must be < 0x80.
+inline uint64_t in_range(uint64_t v, uint8_t lo, uint8_t hi)
+{
+    return (v + ones * (0x80 - lo)) & ~(v + ones * (0x7f - hi)) & high;
+}
+
+// Decode eight hex characters into four bytes, first pair lowest.
+inline bool decode8(uint64_t v, uint32_t &out)
+{
+    if (v & high)
+        return false;
+
+    uint64_t digit = in_range(v, '0', '9');
+    uint64_t alpha = in_range(v | (ones * 0x20), 'a', 'f');
+    if ((digit | alpha) != high)
+        return false;
+
+    // '0'-'9' map to their low nibble, letters to low nibble + 9.
+    uint64_t n = (v & (ones * 0x0f)) + ((v >> 6) & ones) * 9;
+
+    // Pair nibbles into bytes, then squeeze the 16-bit lanes together.
+    uint64_t pairs = ((n & 0x00ff00ff00ff00ffull) << 4) |
+                     ((n >> 8) & 0x00ff00ff00ff00ffull);
+    pairs = (pairs | (pairs >> 8)) & 0x0000ffff0000ffffull;
+    pairs = (pairs | (pairs >> 16)) & 0x00000000ffffffffull;
+    out = static_cast<uint32_t>(pairs);
+    return true;
+}
+
+} // namespace
+
+bool color::hex::decode_batch(const char *in, std::size_t count,
+                              uint32_t *out)
+{
+    std::size_t i = 0;
+
+    // Four colors are 24 characters: three words, twelve bytes.
+    for (; i + 4 <= count; i += 4, in += 4 * width) {
+        uint32_t w[3];
+        if (!decode8(load(in), w[0]) || !decode8(load(in + 8), w[1]) ||
+            !decode8(load(in + 16), w[2]))
+            return false;
+
+        uint8_t bytes[12];
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 4; ++k)
+                bytes[j * 4 + k] = (w[j] >> (k * 8)) & 0xff;
+        }
+
+        for (int j = 0; j < 4; ++j) {
+            out[i + j] = (uint32_t(bytes[j * 3]) << 16) |
+                         (uint32_t(bytes[j * 3 + 1]) << 8) |
+                         bytes[j * 3 + 2];
+        }
+    }
+
+    for (; i < count; ++i, in += width) {
+        auto value = decode(std::string_view(in, width));
+        if (!value)
+            return false;
+        out[i] = *value;
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef COLOR_HEX_HPP
+#define COLOR_HEX_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace color
+{
+
+namespace hex
+{
+
+// Number of characters in an encoded color: "rrggbb".
+constexpr std::size_t width = 6;
+
+// Nibble value of every byte, or `invalid` for non-hex characters.
+constexpr uint8_t invalid = 0xff;
+
+constexpr std::array<uint8_t, 256> make_decode_table(void)
+{
+    std::array<uint8_t, 256> table{};
+    for (auto &e : table)
+        e = invalid;
+    for (int i = 0; i < 10; ++i)
+        table['0' + i] = i;
+    for (int i = 0; i < 6; ++i) {
+        table['a' + i] = 10 + i;
+        table['A' + i] = 10 + i;
+    }
+    return table;
+}
+
+inline constexpr auto decode_table = make_decode_table();
+inline constexpr char digits[] = "0123456789abcdef";
+
+/**
+ * @brief Decode exactly six hex characters into a packed 0xRRGGBB value.
+ *
+ * @param s Characters to decode; case-insensitive.
+ * @returns The packed value, or std::nullopt if s is not exactly six
+ *          valid hex characters.
+ **/
+constexpr std::optional<uint32_t> decode(std::string_view s)
+{
+    if (s.size() != width)
+        return std::nullopt;
+
+    uint32_t value = 0;
+    uint8_t bad = 0;
+    for (char c : s) {
+        uint8_t n = decode_table[static_cast<unsigned char>(c)];
+        // Every invalid nibble has its high bit set; accumulate them
+        // instead of branching per character.
+        bad |= n;
+        value = (value << 4) | (n & 0xf);
+    }
+
+    if (bad & 0xf0)
+        return std::nullopt;
+    return value;
+}
+
+/**
+ * @brief Encode a packed 0xRRGGBB value as six lowercase hex characters.
+ *
+ * @param out Destination; must have room for hex::width characters.
+ * @param value Packed color to encode.
+ * @returns Pointer one past the last character written.
+ **/
+constexpr char *encode(char *out, uint32_t value)
+{
+    for (std::size_t i = 0; i < width; ++i)
+        out[i] = digits[(value >> (20 - i * 4)) & 0xf];
+    return out + width;
+}
+
+/**
+ * @brief Decode count colors packed back to back ("rrggbbrrggbb...").
+ *
+ * Groups of four colors are decoded eight characters at a time with
+ * SWAR arithmetic on 64-bit words; any remainder falls back to the
+ * table decoder.
+ *
+ * @param in At least count * hex::width characters.
+ * @param count Number of colors to decode.
+ * @param out Destination for count packed 0xRRGGBB values.
+ * @returns false if any character was not a hex digit, in which case
+ *          the contents of out are unspecified.
+ **/
+bool decode_batch(const char *in, std::size_t count, uint32_t *out);
+
+}; // namespace hex
+
+}; // namespace color
+
+#endif /* COLOR_HEX_HPP */
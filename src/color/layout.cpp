@@ -0,0 +1,127 @@
+#include "layout.hpp"
+#include "../fs.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+using namespace color;
+
+std::string zone::path(const std::string &dir) const
+{
+    if (!file.empty() && file[0] == '/')
+        return file;
+
+    // One allocation; dir + file would take two.
+    std::string out;
+    out.reserve(dir.size() + file.size());
+    out.append(dir).append(file);
+    return out;
+}
+
+layout::layout(std::string name, std::vector<zone> zones)
+    : m_name(std::move(name))
+    , m_zones(std::move(zones))
+{
+}
+
+const std::string &layout::name(void) const
+{
+    return m_name;
+}
+
+const std::vector<zone> &layout::zones(void) const
+{
+    return m_zones;
+}
+
+std::size_t layout::size(void) const
+{
+    return m_zones.size();
+}
+
+std::optional<std::size_t> layout::find(std::string_view name) const
+{
+    for (std::size_t i = 0; i < m_zones.size(); ++i) {
+        if (m_zones[i].name == name)
+            return i;
+    }
+    return std::nullopt;
+}
+
+// Compiled-in layouts; the first attribute of each is what
+// detect_layout() looks for.
+static const std::vector<layout> &builtins(void)
+{
+    static const std::vector<layout> table = {
+        {"four-zone",
+         {{"left", "color_left"},
+          {"center", "color_center"},
+          {"right", "color_right"},
+          {"extra", "color_extra"}}},
+        {"single-zone", {{"all", "color"}}},
+        {"multicolor", {{"all", "multi_intensity", encoding::intensity}}},
+    };
+    return table;
+}
+
+const layout &color::four_zone(void)
+{
+    return builtins().front();
+}
+
+const layout *color::find_layout(std::string_view name)
+{
+    for (auto &l : builtins()) {
+        if (l.name() == name)
+            return &l;
+    }
+    return nullptr;
+}
+
+std::vector<std::string_view> color::layout_names(void)
+{
+    std::vector<std::string_view> names;
+    for (auto &l : builtins())
+        names.push_back(l.name());
+    return names;
+}
+
+layout color::load_layout(const std::string &path)
+{
+    std::ifstream ifs(path);
+    if (!ifs)
+        throw std::runtime_error("Unable to read layout " + path + ".");
+
+    std::vector<zone> zones;
+    std::string line;
+    for (std::size_t n = 1; std::getline(ifs, line); ++n) {
+        std::istringstream ss(line);
+        zone z;
+        if (!(ss >> z.name) || z.name[0] == '#')
+            continue;
+
+        std::string enc, rest;
+        ss >> z.file >> enc >> rest;
+        if (enc == "intensity")
+            z.encoding = encoding::intensity;
+        if (z.file.empty() || (!enc.empty() && enc != "hex" &&
+                               enc != "intensity") ||
+            !rest.empty()) {
+            throw std::runtime_error("Malformed layout " + path + ":" +
+                                     std::to_string(n) + ".");
+        }
+        zones.push_back(std::move(z));
+    }
+
+    if (zones.empty())
+        throw std::runtime_error("Layout " + path + " has no zones.");
+    return layout(path, std::move(zones));
+}
+
+const layout &color::detect_layout(const std::string &dir)
+{
+    for (auto &l : builtins()) {
+        if (fs::exists(l.zones().front().path(dir)))
+            return l;
+    }
+    return four_zone();
+}
@@ -0,0 +1,102 @@
+#ifndef COLOR_LAYOUT_HPP
+#define COLOR_LAYOUT_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace color
+{
+
+// How a zone's attribute spells a color.
+enum class encoding {
+    hex,       // "rrggbb", like color_left.
+    intensity, // "r g b" in decimal, like a multicolor LED's
+               // multi_intensity.
+};
+
+/**
+ * @brief One independently colored part of a keyboard: a zone or a key.
+ **/
+struct zone {
+    // Name used in layout files and messages, e.g. "left".
+    std::string name;
+
+    // Attribute holding the color; relative to the device directory
+    // unless it starts with a slash.
+    std::string file;
+
+    color::encoding encoding = encoding::hex;
+
+    // Path of the attribute of the device whose attributes live in dir.
+    std::string path(const std::string &dir) const;
+};
+
+/**
+ * @brief Maps a keyboard's zones or keys to sysfs attributes.
+ *
+ * Layouts either come from the compiled-in table (see find_layout())
+ * or from a layout file (see load_layout()).
+ **/
+class layout
+{
+private:
+    std::string m_name;
+    std::vector<zone> m_zones;
+
+public:
+    layout(std::string name, std::vector<zone> zones);
+
+    const std::string &name(void) const;
+    const std::vector<zone> &zones(void) const;
+    std::size_t size(void) const;
+
+    // Index of the zone called name.
+    std::optional<std::size_t> find(std::string_view name) const;
+};
+
+/**
+ * @brief The left, center, right and extra zones of system76 keyboards.
+ **/
+const layout &four_zone(void);
+
+/**
+ * @brief The compiled-in layout called name, if there is one.
+ *
+ * Provides "four-zone", "single-zone" (system76_acpi's single color
+ * attribute) and "multicolor" (a multicolor LED class device).
+ **/
+const layout *find_layout(std::string_view name);
+
+/**
+ * @brief Names of every compiled-in layout.
+ **/
+std::vector<std::string_view> layout_names(void);
+
+/**
+ * @brief Load a layout file.
+ *
+ * Every line that isn't blank or a '#' comment describes a zone:
+ *
+ *     <name> <attribute> [hex|intensity]
+ *
+ * Zones are driven in file order; the first four are the ones -l, -c,
+ * -r and -e address.
+ *
+ * @throws std::runtime_error if path can't be read, has a malformed
+ *         line or describes no zones.
+ **/
+layout load_layout(const std::string &path);
+
+/**
+ * @brief The compiled-in layout matching the attributes found in dir.
+ *
+ * Falls back to four_zone() when nothing matches.
+ **/
+const layout &detect_layout(const std::string &dir);
+
+}; // namespace color
+
+#endif /* COLOR_LAYOUT_HPP */
@@ -1,84 +1,38 @@
 #include "rgb.hpp"
-#include <iomanip>
-#include <sstream>
 using namespace color;
 
-rgb::rgb(const std::string &rgb_s)
+rgb::rgb(std::string_view rgb_s)
 {
-    uint32_t c;
-
-    sscanf(rgb_s.substr(0, 2).c_str(), "%02X", &c);
-    m_value.r = c;
-
-    sscanf(rgb_s.substr(2, 2).c_str(), "%02X", &c);
-    m_value.g = c;
-
-    sscanf(rgb_s.substr(4, 2).c_str(), "%02X", &c);
-    m_value.b = c;
-}
-
-rgb::rgb(const rgb &other)
-    : m_value(other.m_value)
-{
-}
-
-rgb::rgb(rgb &&other)
-    : m_value(std::move(other.m_value))
-{
-}
-
-rgb &rgb::operator=(const rgb &other)
-{
-    m_value = other.m_value;
-    return *this;
-}
-
-rgb &rgb::operator=(rgb &&other)
-{
-    m_value = std::move(other.m_value);
-    return *this;
-}
-
-bool rgb::operator==(const rgb &other) const
-{
-    return m_value.value == other.m_value.value;
-}
-
-bool rgb::operator!=(const rgb &other) const
-{
-    return m_value.value != other.m_value.value;
-}
-
-uint32_t rgb::red(uint32_t value)
-{
-    m_value.r = value;
-    return m_value.r;
-}
-
-uint32_t rgb::green(uint32_t value)
-{
-    m_value.g = value;
-    return m_value.g;
-}
-
-uint32_t rgb::blue(uint32_t value)
-{
-    m_value.b = value;
-    return m_value.b;
-}
-const uint32_t rgb::red(void) const
-{
-    return m_value.r;
+    auto value = hex::decode(rgb_s);
+    if (!value) {
+        throw std::invalid_argument("Invalid color '" + std::string(rgb_s) +
+                                    "'; expected six hex digits.");
+    }
+    m_value = *value;
 }
 
-const uint32_t rgb::green(void) const
+std::to_chars_result color::to_chars(char *first, char *last, const rgb &c)
 {
-    return m_value.g;
+    if (last - first < static_cast<std::ptrdiff_t>(hex::width))
+        return {last, std::errc::value_too_large};
+    return {hex::encode(first, c.value()), std::errc()};
 }
 
-const uint32_t rgb::blue(void) const
+bool color::from_chars_batch(const char *in, std::size_t count, rgb *out)
 {
-    return m_value.b;
+    // rgb is a single packed word, and decoded values never have the
+    // top byte set; decode in chunks and copy them straight in.
+    uint32_t values[64];
+    while (count) {
+        std::size_t n = count < 64 ? count : 64;
+        if (!hex::decode_batch(in, n, values))
+            return false;
+        memcpy(out, values, n * sizeof(rgb));
+        in += n * hex::width;
+        out += n;
+        count -= n;
+    }
+    return true;
 }
 
 namespace std
@@ -86,12 +40,10 @@ namespace std
 
 string to_string(const rgb &c)
 {
-    // Reformat the stringstream for each uint32_t we stream to it. This
-    // forces each number to be treated as a size 2 hex value.
-    stringstream ss;
-    ss << hex << setw(2) << setfill('0') << c.red() << setw(2) << setfill('0')
-       << c.green() << setw(2) << setfill('0') << c.blue();
-    return ss.str();
+    // Six characters fit in the small string buffer; no allocation.
+    char buf[color::hex::width];
+    color::hex::encode(buf, c.value());
+    return string(buf, sizeof(buf));
 }
 
 }; // namespace std
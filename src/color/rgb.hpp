@@ -1,51 +1,161 @@
 #ifndef RGB_HPP
 #define RGB_HPP
 
-#include "../cache.hpp"
+#include "../state_file.hpp"
 #include "../logging.hpp"
+#include "hex.hpp"
 #include <array>
+#include <charconv>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
-
-#define COLOR_CACHE JOIN(CACHE_PREFIX, "colors")
+#include <string_view>
+#include <type_traits>
 
 namespace color
 {
 
+/**
+ * @brief A color as one packed 0xRRGGBB word.
+ *
+ * rgb is a trivially copyable, standard-layout 4-byte value whose top
+ * byte is always zero, so arrays of colors can be memcpy'd to and from
+ * packed uint32_t values, and everything but parsing a runtime string
+ * is constexpr.
+ **/
 class rgb
 {
 private:
-    union rgb_value {
-        uint32_t value = 0;
-        struct {
-            uint32_t b : 8, g : 8, r : 8, : 8;
-        };
-    };
-
-    union rgb_value m_value;
+    uint32_t m_value = 0;
 
 public:
-    rgb(void) = default;
-    rgb(const std::string &rgb_s);
+    constexpr rgb(void) = default;
+
+    /**
+     * @brief Construct from six hex characters, e.g. "ff8800".
+     *
+     * @throws std::invalid_argument if rgb_s is not exactly six hex
+     *         characters.
+     **/
+    rgb(std::string_view rgb_s);
+
+    /**
+     * @brief Construct from a packed 0xRRGGBB value.
+     **/
+    constexpr explicit rgb(uint32_t value)
+        : m_value(value & 0xffffff)
+    {
+    }
+
+    constexpr rgb(uint8_t r, uint8_t g, uint8_t b)
+        : m_value(uint32_t(r) << 16 | uint32_t(g) << 8 | b)
+    {
+    }
+
+    constexpr bool operator==(const rgb &other) const
+    {
+        return m_value == other.m_value;
+    }
+
+    constexpr bool operator!=(const rgb &other) const
+    {
+        return m_value != other.m_value;
+    }
+
+    // Set a channel to the low byte of value; returns the new channel.
+    constexpr uint32_t red(uint32_t value)
+    {
+        return set(16, value);
+    }
+
+    constexpr uint32_t green(uint32_t value)
+    {
+        return set(8, value);
+    }
+
+    constexpr uint32_t blue(uint32_t value)
+    {
+        return set(0, value);
+    }
 
-    rgb(const rgb &other);
-    rgb(rgb &&other);
+    constexpr uint32_t red(void) const
+    {
+        return m_value >> 16;
+    }
 
-    rgb &operator=(const rgb &other);
-    rgb &operator=(rgb &&other);
+    constexpr uint32_t green(void) const
+    {
+        return (m_value >> 8) & 0xff;
+    }
 
-    bool operator==(const rgb &other) const;
-    bool operator!=(const rgb &other) const;
+    constexpr uint32_t blue(void) const
+    {
+        return m_value & 0xff;
+    }
 
-    uint32_t red(uint32_t value);
-    uint32_t green(uint32_t value);
-    uint32_t blue(uint32_t value);
+    // Packed 0xRRGGBB value.
+    constexpr uint32_t value(void) const
+    {
+        return m_value;
+    }
 
-    const uint32_t red(void) const;
-    const uint32_t green(void) const;
-    const uint32_t blue(void) const;
+private:
+    constexpr uint32_t set(unsigned shift, uint32_t value)
+    {
+        value &= 0xff;
+        m_value = (m_value & ~(0xffu << shift)) | value << shift;
+        return value;
+    }
 };
 
+static_assert(sizeof(rgb) == sizeof(uint32_t) &&
+                  std::is_trivially_copyable_v<rgb> &&
+                  std::is_standard_layout_v<rgb>,
+              "rgb is a plain packed word");
+
+// consteval where the compiler has it.
+#if __cpp_consteval
+#define COLOR_CONSTEVAL consteval
+#else
+#define COLOR_CONSTEVAL constexpr
+#endif
+
+namespace literals
+{
+
+/**
+ * @brief "ff8800"_rgb.
+ *
+ * A malformed literal doesn't compile: with C++20 the operator is
+ * consteval, and a throw is never a constant expression. C++17 builds
+ * only catch it where the color initializes a constexpr variable.
+ **/
+COLOR_CONSTEVAL rgb operator""_rgb(const char *s, std::size_t size)
+{
+    auto value = hex::decode(std::string_view(s, size));
+    if (!value)
+        throw std::invalid_argument("expected six hex digits");
+    return rgb(*value);
+}
+
+}; // namespace literals
+
+/**
+ * @brief Write c as six lowercase hex characters into [first, last).
+ *
+ * Mirrors std::to_chars: on success ptr is one past the last character
+ * written; if the range is too small, ec is std::errc::value_too_large.
+ **/
+std::to_chars_result to_chars(char *first, char *last, const rgb &c);
+
+/**
+ * @brief Decode count back to back colors from in into out.
+ *
+ * @returns false if in contains anything but hex digits.
+ **/
+bool from_chars_batch(const char *in, std::size_t count, rgb *out);
+
 }; // namespace color
 
 namespace std
@@ -55,9 +165,10 @@ string to_string(const color::rgb &c);
 template <std::size_t N>
 string to_string(const std::array<color::rgb, N> &arr)
 {
-    string tmp;
+    string tmp(N * color::hex::width, '\0');
+    char *p = tmp.data();
     for (auto &e : arr)
-        tmp.append(to_string(e));
+        p = color::hex::encode(p, e.value());
     return tmp;
 }
 
@@ -66,30 +177,42 @@ string to_string(const std::array<color::rgb, N> &arr)
 namespace fs
 {
 
-template <typename T = std::string>
-class color_cache : public cache<T>
+/**
+ * @brief The four region colors kept in a state_file.
+ **/
+class color_cache
 {
+private:
+    state_file &m_file;
+
 public:
-    color_cache(void)
-        : cache<T>(COLOR_CACHE)
+    explicit color_cache(state_file &file)
+        : m_file(file)
+    {
+    }
+
+    bool exists(void) const
     {
+        return m_file.has(state_file::colors);
     }
 
     std::optional<std::array<color::rgb, 4>> data(void) const
     {
-        if (!cache<T>::exists())
+        auto values = m_file.region_colors();
+        if (!values)
             return std::nullopt;
 
-        const auto s = cache<T>::data().value();
-        // This will throw std::out_of_range on an invalid cache value.
-        return std::array<color::rgb, 4>{
-            color::rgb(s.substr(0, 6)), color::rgb(s.substr(6, 6)),
-            color::rgb(s.substr(12, 6)), color::rgb(s.substr(18, 6))};
+        std::array<color::rgb, 4> colors;
+        for (std::size_t i = 0; i < colors.size(); ++i)
+            colors[i] = color::rgb((*values)[i]);
+        return colors;
     }
 
     void set_data(const std::array<color::rgb, 4> &regions)
     {
-        cache<T>::set_data(std::to_string(regions));
+        std::array<uint32_t, 4> values;
+        memcpy(values.data(), regions.data(), sizeof(values));
+        m_file.set_region_colors(values);
     }
 };
 
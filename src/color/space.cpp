@@ -0,0 +1,365 @@
+#include "space.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+using namespace color;
+
+// Samples in the encoding table; enough for an exact 8-bit round trip.
+static constexpr std::size_t encode_steps = 4096;
+
+// Colors converted per pass of a batch kernel in gradient().
+static constexpr std::size_t chunk = 64;
+
+static float decode(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float encode(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f
+                           : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static const std::array<float, 256> &decode_table(void)
+{
+    static const auto table = [] {
+        std::array<float, 256> t;
+        for (std::size_t i = 0; i < t.size(); ++i)
+            t[i] = decode(i / 255.0f);
+        return t;
+    }();
+    return table;
+}
+
+static const std::array<uint8_t, encode_steps + 1> &encode_table(void)
+{
+    static const auto table = [] {
+        std::array<uint8_t, encode_steps + 1> t;
+        for (std::size_t i = 0; i < t.size(); ++i)
+            t[i] = std::lround(encode(float(i) / encode_steps) * 255.0f);
+        return t;
+    }();
+    return table;
+}
+
+static uint8_t encode_with(const std::array<uint8_t, encode_steps + 1> &t,
+                           float c)
+{
+    c = std::clamp(c, 0.0f, 1.0f);
+    return t[static_cast<std::size_t>(c * encode_steps + 0.5f)];
+}
+
+std::optional<space> color::parse_space(std::string_view name)
+{
+    if (name == "srgb")
+        return space::srgb;
+    if (name == "linear")
+        return space::linear;
+    if (name == "hsv")
+        return space::hsv;
+    if (name == "hsl")
+        return space::hsl;
+    if (name == "oklab")
+        return space::oklab;
+    return std::nullopt;
+}
+
+float color::to_linear(uint8_t c)
+{
+    return decode_table()[c];
+}
+
+uint8_t color::from_linear(float c)
+{
+    return encode_with(encode_table(), c);
+}
+
+linear_rgb color::to_linear(const rgb &c)
+{
+    auto &t = decode_table();
+    return {t[c.red()], t[c.green()], t[c.blue()]};
+}
+
+rgb color::from_linear(const linear_rgb &c)
+{
+    auto &t = encode_table();
+    return rgb(encode_with(t, c.r), encode_with(t, c.g), encode_with(t, c.b));
+}
+
+static uint8_t channel(float c)
+{
+    return std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+}
+
+// Hue in degrees of r, g, b, given their largest and smallest.
+static float hue_of(float r, float g, float b, float max, float delta)
+{
+    if (delta <= 0.0f)
+        return 0.0f;
+    float h;
+    if (max == r)
+        h = (g - b) / delta;
+    else if (max == g)
+        h = (b - r) / delta + 2.0f;
+    else
+        h = (r - g) / delta + 4.0f;
+    h *= 60.0f;
+    return h < 0.0f ? h + 360.0f : h;
+}
+
+// r, g, b from a hue and the chroma and smallest channel it spans.
+static rgb from_hue(float h, float chroma, float min)
+{
+    h = std::fmod(h, 360.0f);
+    if (h < 0.0f)
+        h += 360.0f;
+    float x = chroma * (1.0f - std::fabs(std::fmod(h / 60.0f, 2.0f) - 1.0f));
+
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    switch (static_cast<int>(h / 60.0f)) {
+    case 0:
+        r = chroma, g = x;
+        break;
+    case 1:
+        r = x, g = chroma;
+        break;
+    case 2:
+        g = chroma, b = x;
+        break;
+    case 3:
+        g = x, b = chroma;
+        break;
+    case 4:
+        r = x, b = chroma;
+        break;
+    default:
+        r = chroma, b = x;
+        break;
+    }
+    return rgb(channel(r + min), channel(g + min), channel(b + min));
+}
+
+hsv color::to_hsv(const rgb &c)
+{
+    float r = c.red() / 255.0f, g = c.green() / 255.0f,
+          b = c.blue() / 255.0f;
+    float max = std::max({r, g, b});
+    float delta = max - std::min({r, g, b});
+    return {hue_of(r, g, b, max, delta), max > 0.0f ? delta / max : 0.0f,
+            max};
+}
+
+rgb color::from_hsv(const hsv &c)
+{
+    float chroma = c.v * c.s;
+    return from_hue(c.h, chroma, c.v - chroma);
+}
+
+hsl color::to_hsl(const rgb &c)
+{
+    float r = c.red() / 255.0f, g = c.green() / 255.0f,
+          b = c.blue() / 255.0f;
+    float max = std::max({r, g, b});
+    float min = std::min({r, g, b});
+    float delta = max - min;
+    float l = (max + min) / 2.0f;
+    float s = delta > 0.0f ? delta / (1.0f - std::fabs(2.0f * l - 1.0f))
+                           : 0.0f;
+    return {hue_of(r, g, b, max, delta), s, l};
+}
+
+rgb color::from_hsl(const hsl &c)
+{
+    float chroma = (1.0f - std::fabs(2.0f * c.l - 1.0f)) * c.s;
+    return from_hue(c.h, chroma, c.l - chroma / 2.0f);
+}
+
+oklab color::to_oklab(const linear_rgb &c)
+{
+    oklab out;
+    to_oklab(&c.r, &c.g, &c.b, &out.L, &out.a, &out.b, 1);
+    return out;
+}
+
+linear_rgb color::from_oklab(const oklab &c)
+{
+    linear_rgb out;
+    from_oklab(&c.L, &c.a, &c.b, &out.r, &out.g, &out.b, 1);
+    return out;
+}
+
+oklab color::to_oklab(const rgb &c)
+{
+    return to_oklab(to_linear(c));
+}
+
+static float lerp(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+// Interpolate hues along the shorter arc; a gray (no saturation) takes
+// the other hue.
+static float lerp_hue(float a, float sa, float b, float sb, float t)
+{
+    if (sa <= 0.0f)
+        return b;
+    if (sb <= 0.0f)
+        return a;
+    float d = b - a;
+    if (d > 180.0f)
+        d -= 360.0f;
+    else if (d < -180.0f)
+        d += 360.0f;
+    return a + d * t;
+}
+
+rgb color::mix(const rgb &a, const rgb &b, float t, space s)
+{
+    switch (s) {
+    case space::srgb:
+        return rgb(channel(lerp(a.red(), b.red(), t) / 255.0f),
+                   channel(lerp(a.green(), b.green(), t) / 255.0f),
+                   channel(lerp(a.blue(), b.blue(), t) / 255.0f));
+    case space::linear: {
+        auto x = to_linear(a), y = to_linear(b);
+        return from_linear({lerp(x.r, y.r, t), lerp(x.g, y.g, t),
+                            lerp(x.b, y.b, t)});
+    }
+    case space::hsv: {
+        auto x = to_hsv(a), y = to_hsv(b);
+        return from_hsv({lerp_hue(x.h, x.s, y.h, y.s, t), lerp(x.s, y.s, t),
+                         lerp(x.v, y.v, t)});
+    }
+    case space::hsl: {
+        auto x = to_hsl(a), y = to_hsl(b);
+        return from_hsl({lerp_hue(x.h, x.s, y.h, y.s, t), lerp(x.s, y.s, t),
+                         lerp(x.l, y.l, t)});
+    }
+    case space::oklab:
+    default: {
+        auto x = to_oklab(a), y = to_oklab(b);
+        return from_linear(from_oklab(
+            {lerp(x.L, y.L, t), lerp(x.a, y.a, t), lerp(x.b, y.b, t)}));
+    }
+    }
+}
+
+void color::to_linear(const uint8_t *in, float *out, std::size_t n)
+{
+    auto &t = decode_table();
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = t[in[i]];
+}
+
+void color::from_linear(const float *in, uint8_t *out, std::size_t n)
+{
+    auto &t = encode_table();
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = encode_with(t, in[i]);
+}
+
+void color::to_oklab(const float *r, const float *g, const float *b,
+                     float *L, float *A, float *B, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        float l = std::cbrt(0.4122214708f * r[i] + 0.5363325363f * g[i] +
+                            0.0514459929f * b[i]);
+        float m = std::cbrt(0.2119034982f * r[i] + 0.6806995451f * g[i] +
+                            0.1073969566f * b[i]);
+        float s = std::cbrt(0.0883024619f * r[i] + 0.2817188376f * g[i] +
+                            0.6299787005f * b[i]);
+        L[i] = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+        A[i] = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+        B[i] = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+    }
+}
+
+void color::from_oklab(const float *L, const float *A, const float *B,
+                       float *r, float *g, float *b, std::size_t n)
+{
+    // Cubing where the other direction takes cube roots: plain
+    // multiply-adds all the way.
+    for (std::size_t i = 0; i < n; ++i) {
+        float l = L[i] + 0.3963377774f * A[i] + 0.2158037573f * B[i];
+        float m = L[i] - 0.1055613458f * A[i] - 0.0638541728f * B[i];
+        float s = L[i] - 0.0894841775f * A[i] - 1.2914855480f * B[i];
+        l = l * l * l;
+        m = m * m * m;
+        s = s * s * s;
+        r[i] = 4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s;
+        g[i] = -1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s;
+        b[i] = -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s;
+    }
+}
+
+// Where color i of n falls between the stops: the segment starting at
+// *k and how far along it.
+static float position(std::size_t i, std::size_t n, std::size_t count,
+                      std::size_t *k)
+{
+    float x = n > 1 ? float(i) * (count - 1) / (n - 1) : 0.0f;
+    *k = std::min<std::size_t>(x, count - 2);
+    return x - *k;
+}
+
+void color::gradient(const rgb *stops, std::size_t count, space s,
+                     buffer &out)
+{
+    const std::size_t n = out.size();
+    if (!count)
+        return;
+    if (count == 1) {
+        out.fill(stops[0]);
+        return;
+    }
+
+    // Only linear and OKLab go through the batch kernels; the others
+    // mix one color at a time.
+    if (s != space::linear && s != space::oklab) {
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t k;
+            float t = position(i, n, count, &k);
+            out.set(i, mix(stops[k], stops[k + 1], t, s));
+        }
+        return;
+    }
+
+    // Every stop is converted once, then each chunk of colors is laid
+    // out in planes: interpolated, converted back and encoded.
+    std::vector<std::array<float, 3>> points(count);
+    for (std::size_t k = 0; k < count; ++k) {
+        auto c = to_linear(stops[k]);
+        if (s == space::oklab) {
+            auto lab = to_oklab(c);
+            points[k] = {lab.L, lab.a, lab.b};
+        } else {
+            points[k] = {c.r, c.g, c.b};
+        }
+    }
+
+    float x[chunk], y[chunk], z[chunk], r[chunk], g[chunk], b[chunk];
+    for (std::size_t base = 0; base < n; base += chunk) {
+        std::size_t m = std::min(chunk, n - base);
+        for (std::size_t i = 0; i < m; ++i) {
+            std::size_t k;
+            float t = position(base + i, n, count, &k);
+            x[i] = lerp(points[k][0], points[k + 1][0], t);
+            y[i] = lerp(points[k][1], points[k + 1][1], t);
+            z[i] = lerp(points[k][2], points[k + 1][2], t);
+        }
+
+        if (s == space::oklab) {
+            from_oklab(x, y, z, r, g, b, m);
+            from_linear(r, out.r() + base, m);
+            from_linear(g, out.g() + base, m);
+            from_linear(b, out.b() + base, m);
+        } else {
+            from_linear(x, out.r() + base, m);
+            from_linear(y, out.g() + base, m);
+            from_linear(z, out.b() + base, m);
+        }
+    }
+}
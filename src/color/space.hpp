@@ -0,0 +1,101 @@
+#ifndef COLOR_SPACE_HPP
+#define COLOR_SPACE_HPP
+
+#include "buffer.hpp"
+#include "rgb.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace color
+{
+
+// Where two colors are mixed.
+enum class space {
+    srgb,   // The encoded channels, as they are written to sysfs.
+    linear, // Linear light: physically correct, perceptually uneven.
+    hsv,    // Hue, saturation and value, along the shorter hue arc.
+    hsl,    // Hue, saturation and lightness, likewise.
+    oklab,  // Perceptually uniform lightness and hue.
+};
+
+std::optional<space> parse_space(std::string_view name);
+
+// Linear-light RGB, each channel in [0, 1].
+struct linear_rgb {
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+};
+
+// Hue in degrees [0, 360); saturation and value in [0, 1].
+struct hsv {
+    float h = 0.0f, s = 0.0f, v = 0.0f;
+};
+
+// Hue in degrees [0, 360); saturation and lightness in [0, 1].
+struct hsl {
+    float h = 0.0f, s = 0.0f, l = 0.0f;
+};
+
+// Björn Ottosson's OKLab: lightness L in [0, 1] and the a/b axes.
+struct oklab {
+    float L = 0.0f, a = 0.0f, b = 0.0f;
+};
+
+/**
+ * @brief sRGB transfer function, both ways, through lookup tables.
+ *
+ * Decoding indexes a 256-entry table; encoding indexes one sampled
+ * finely enough that every 8-bit value survives a round trip. Both are
+ * built the first time they're needed.
+ **/
+float to_linear(uint8_t c);
+uint8_t from_linear(float c);
+
+linear_rgb to_linear(const rgb &c);
+rgb from_linear(const linear_rgb &c);
+
+hsv to_hsv(const rgb &c);
+rgb from_hsv(const hsv &c);
+
+hsl to_hsl(const rgb &c);
+rgb from_hsl(const hsl &c);
+
+oklab to_oklab(const linear_rgb &c);
+linear_rgb from_oklab(const oklab &c);
+
+oklab to_oklab(const rgb &c);
+
+/**
+ * @brief Interpolate from a (t = 0) to b (t = 1) in space s.
+ *
+ * Hues go the shorter way around, and a gray takes the other color's
+ * hue rather than swinging through red.
+ **/
+rgb mix(const rgb &a, const rgb &b, float t, space s);
+
+/**
+ * Batch kernels over planar data: n values per plane, no aliasing
+ * between inputs and outputs. The arithmetic ones are straight loops
+ * the compiler vectorizes.
+ **/
+void to_linear(const uint8_t *in, float *out, std::size_t n);
+void from_linear(const float *in, uint8_t *out, std::size_t n);
+
+// Linear RGB planes to OKLab planes, and back.
+void to_oklab(const float *r, const float *g, const float *b, float *L,
+              float *A, float *B, std::size_t n);
+void from_oklab(const float *L, const float *A, const float *B, float *r,
+                float *g, float *b, std::size_t n);
+
+/**
+ * @brief Color out with a gradient through count stops, mixed in s.
+ *
+ * The stops are spread evenly from the first color of out to the last;
+ * a single stop fills it.
+ **/
+void gradient(const rgb *stops, std::size_t count, space s, buffer &out);
+
+}; // namespace color
+
+#endif /* COLOR_SPACE_HPP */
@@ -0,0 +1,71 @@
+#include "device.hpp"
+#include "state_file.hpp"
+#include <algorithm>
+#include <dirent.h>
+
+using namespace led;
+
+static constexpr std::string_view vendor = "system76";
+static constexpr std::string_view function = "::kbd_backlight";
+
+static bool matches(std::string_view name)
+{
+    return name.size() >= vendor.size() + function.size() &&
+           name.substr(0, vendor.size()) == vendor &&
+           name.substr(name.size() - function.size()) == function;
+}
+
+// Keep the default device's caches where they have always been; every
+// other device gets its own state file next to them.
+static device make_device(std::string name, std::string path)
+{
+    std::string cache = STATE_PATH;
+    if (path != SYSFS_PREFIX)
+        cache += "@" + name;
+    return {std::move(name), std::move(path), std::move(cache)};
+}
+
+device led::default_device(void)
+{
+    std::string_view path(SYSFS_PREFIX);
+    auto dir = path.substr(0, path.size() - 1);
+    auto name = dir.substr(dir.find_last_of('/') + 1);
+    return make_device(std::string(name), std::string(path));
+}
+
+std::vector<device> led::discover(void)
+{
+    std::vector<device> devices;
+    DIR *dir = opendir(LEDS_PREFIX);
+    if (!dir)
+        return devices;
+
+    while (auto *entry = readdir(dir)) {
+        std::string name(entry->d_name);
+        if (matches(name))
+            devices.push_back(
+                make_device(name, std::string(LEDS_PREFIX) + name + "/"));
+    }
+    closedir(dir);
+
+    std::sort(devices.begin(), devices.end(),
+              [](const device &a, const device &b) {
+                  bool a_default = a.path == SYSFS_PREFIX;
+                  bool b_default = b.path == SYSFS_PREFIX;
+                  if (a_default != b_default)
+                      return a_default;
+                  return a.name < b.name;
+              });
+    return devices;
+}
+
+std::optional<device> led::find_device(std::string_view name)
+{
+    if (name.empty() || name.find('/') != std::string_view::npos)
+        return std::nullopt;
+
+    std::string path = std::string(LEDS_PREFIX) + std::string(name) + "/";
+    if (!fs::exists(path + "brightness"))
+        return std::nullopt;
+    return make_device(std::string(name), path);
+}
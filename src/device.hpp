@@ -0,0 +1,55 @@
+#ifndef DEVICE_HPP
+#define DEVICE_HPP
+
+#include "fs.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Where LED class devices live; each one is a directory in here.
+#ifndef LEDS_PREFIX
+#define LEDS_PREFIX "/sys/class/leds/"
+#endif
+
+namespace led
+{
+
+/**
+ * @brief A keyboard backlight LED class device.
+ **/
+struct device {
+    // LED class name, e.g. "system76_acpi::kbd_backlight".
+    std::string name;
+
+    // Attribute directory, with a trailing slash.
+    std::string path;
+
+    // State file holding this device's caches.
+    std::string cache;
+};
+
+/**
+ * @brief The device at SYSFS_PREFIX, which owns the unsuffixed caches.
+ **/
+device default_device(void);
+
+/**
+ * @brief Every System76 keyboard backlight under LEDS_PREFIX.
+ *
+ * Matches "system76*::kbd_backlight", which covers both the built-in
+ * keyboard and external ones. The default device comes first, the rest
+ * in name order.
+ *
+ * @returns The devices found; empty if LEDS_PREFIX can't be read.
+ **/
+std::vector<device> discover(void);
+
+/**
+ * @brief The LED class device called name, if it exists.
+ **/
+std::optional<device> find_device(std::string_view name);
+
+}; // namespace led
+
+#endif /* DEVICE_HPP */
@@ -0,0 +1,163 @@
+#include "effects.hpp"
+#include "clock.hpp"
+#include "signals.hpp"
+#include <array>
+#include <cmath>
+#include <utility>
+
+using namespace effects;
+
+// Fully saturated colors around the color wheel, 255 steps from each
+// primary or secondary color to the next, worked out at compile time.
+static constexpr std::size_t hue_steps = 6 * 255;
+
+static constexpr std::array<color::rgb, hue_steps> make_hues(void)
+{
+    std::array<color::rgb, hue_steps> table{};
+    for (std::size_t i = 0; i < hue_steps; ++i) {
+        uint8_t f = i % 255;
+        uint8_t q = 255 - f;
+        switch (i / 255) {
+        case 0:
+            table[i] = color::rgb(255, f, 0);
+            break;
+        case 1:
+            table[i] = color::rgb(q, 255, 0);
+            break;
+        case 2:
+            table[i] = color::rgb(0, 255, f);
+            break;
+        case 3:
+            table[i] = color::rgb(0, q, 255);
+            break;
+        case 4:
+            table[i] = color::rgb(f, 0, 255);
+            break;
+        default:
+            table[i] = color::rgb(255, 0, q);
+            break;
+        }
+    }
+    return table;
+}
+
+static constexpr auto hues = make_hues();
+
+// Fully saturated color at hue h in [0, 1).
+static color::rgb hue(double h)
+{
+    h -= std::floor(h);
+    return hues[static_cast<std::size_t>(h * hue_steps + 0.5) % hue_steps];
+}
+
+std::optional<kind> effects::parse(std::string_view name)
+{
+    if (name == "breathing")
+        return kind::breathing;
+    if (name == "rainbow")
+        return kind::rainbow;
+    if (name == "wave")
+        return kind::wave;
+    if (name == "strobe")
+        return kind::strobe;
+    return std::nullopt;
+}
+
+bool frame::operator==(const frame &other) const
+{
+    return level == other.level && colors == other.colors;
+}
+
+bool frame::operator!=(const frame &other) const
+{
+    return !(*this == other);
+}
+
+void effects::render(kind k, const params &p, double t, frame &f)
+{
+    f.colors = p.colors;
+    f.level = p.level;
+    double phase = t / p.period;
+    phase -= std::floor(phase);
+
+    switch (k) {
+    case kind::breathing:
+        f.level = static_cast<uint32_t>(
+            p.level * (0.5 - 0.5 * std::cos(2.0 * M_PI * phase)) + 0.5);
+        break;
+    case kind::rainbow:
+        f.colors.fill(hue(phase));
+        break;
+    case kind::wave:
+        // One full turn across the keyboard, whatever its zone count.
+        for (std::size_t i = 0; i < f.colors.size(); ++i)
+            f.colors.set(i, hue(phase + i / double(f.colors.size())));
+        break;
+    case kind::strobe:
+        if (phase >= 0.5)
+            f.level = 0;
+        break;
+    }
+}
+
+engine::engine(color::keyboard &kb, led::brightness<uint32_t> &brightness,
+               fs::batch &batch)
+    : m_kb(kb)
+    , m_brightness(brightness)
+    , m_batch(batch)
+{
+}
+
+fs::commit_stats engine::commit(void)
+{
+    auto stats = m_kb.commit(m_batch);
+    stats += m_brightness.commit(m_batch);
+    try {
+        m_batch.submit();
+    } catch (...) {
+        m_kb.forget();
+        m_brightness.reload();
+        throw;
+    }
+    return stats;
+}
+
+stats engine::run(kind k, const params &p, unsigned fps, double duration)
+{
+    signals::install();
+
+    stats st;
+    frame f, last;
+    bool first = true;
+    timing::frame_clock clock(fps);
+    const uint64_t frames = std::llround(duration * fps);
+
+    while (signals::running()) {
+        uint64_t elapsed = clock.wait();
+        if (!elapsed)
+            continue;
+        st.dropped += elapsed - 1;
+
+        if (frames && clock.frame() >= frames)
+            break;
+
+        double t = std::chrono::duration<double>(clock.elapsed()).count();
+        render(k, p, t, f);
+        ++st.frames;
+        if (!first && last == f) {
+            ++st.unchanged;
+            continue;
+        }
+
+        m_kb.stage(f.colors);
+        m_brightness.stage_value(f.level);
+        st.writes += commit();
+        std::swap(last, f);
+        first = false;
+    }
+
+    m_kb.stage(p.colors);
+    m_brightness.stage_value(p.level);
+    st.writes += commit();
+    return st;
+}
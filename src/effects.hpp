@@ -0,0 +1,104 @@
+#ifndef EFFECTS_HPP
+#define EFFECTS_HPP
+
+#include "batch.hpp"
+#include "brightness.hpp"
+#include "keyboard.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace effects
+{
+
+enum class kind {
+    breathing, // Base colors, brightness following a raised cosine.
+    rainbow,   // Every region cycling through the hue wheel together.
+    wave,      // Like rainbow, with each region a quarter turn apart.
+    strobe,    // Base colors, brightness on for half of each period.
+};
+
+/**
+ * @brief Look up an effect by its command line name.
+ **/
+std::optional<kind> parse(std::string_view name);
+
+struct params {
+    // Colors (one per zone) and brightness the effect is derived from.
+    color::buffer colors;
+    uint32_t level = 0;
+
+    // Length of one effect cycle, in seconds.
+    double period = 2.0;
+};
+
+// Everything one frame sets on the hardware.
+struct frame {
+    color::buffer colors;
+    uint32_t level = 0;
+
+    bool operator==(const frame &other) const;
+    bool operator!=(const frame &other) const;
+};
+
+/**
+ * @brief Compute the frame for effect k at t seconds into the effect.
+ *
+ * This is a pure function of its arguments, so frames never accumulate
+ * error over time. out is reused, so rendering doesn't allocate once
+ * it has the size of p.colors.
+ **/
+void render(kind k, const params &p, double t, frame &out);
+
+struct stats {
+    // Frames rendered, frames dropped because we fell behind, and
+    // rendered frames identical to the previous one (not written).
+    uint64_t frames = 0;
+    uint64_t dropped = 0;
+    uint64_t unchanged = 0;
+
+    fs::commit_stats writes;
+};
+
+/**
+ * @brief Drives effects on a keyboard at a fixed frame rate.
+ *
+ * Frames are paced by a timing::frame_clock, rendered from the frame's
+ * scheduled time rather than the time we woke up, and pushed through
+ * the keyboard's and brightness' stage/commit path so only attributes
+ * that change between frames are written. What does change goes out
+ * as one fs::batch per frame.
+ **/
+class engine
+{
+private:
+    color::keyboard &m_kb;
+    led::brightness<uint32_t> &m_brightness;
+
+    // Each frame's writes are submitted together through this.
+    fs::batch &m_batch;
+
+public:
+    engine(color::keyboard &kb, led::brightness<uint32_t> &brightness,
+           fs::batch &batch);
+
+    /**
+     * @brief Play effect k until duration elapses or SIGINT/SIGTERM.
+     *
+     * When playback stops, the base colors and level in p are restored.
+     *
+     * @param k Effect to play.
+     * @param p Effect parameters.
+     * @param fps Frames per second.
+     * @param duration Seconds to play for; 0 plays until interrupted.
+     **/
+    stats run(kind k, const params &p, unsigned fps, double duration);
+
+private:
+    fs::commit_stats commit(void);
+};
+
+}; // namespace effects
+
+#endif /* EFFECTS_HPP */
@@ -0,0 +1,269 @@
+#ifndef FADE_HPP
+#define FADE_HPP
+
+#include "brightness.hpp"
+#include "clock.hpp"
+#include "signals.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <sys/timerfd.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace led
+{
+
+/**
+ * @brief Perceptual brightness curve based on CIE 1976 lightness (L*).
+ *
+ * Equal steps in lightness look like equal steps in brightness, unlike
+ * equal steps in the raw level, which crowd all visible change into the
+ * bottom of the range. The lightness -> level direction is precomputed
+ * into a table with one entry per level.
+ **/
+template <typename T>
+class curve
+{
+private:
+    T m_max_level;
+    std::vector<T> m_lut;
+
+public:
+    explicit curve(T max_level)
+        : m_max_level(max_level)
+        , m_lut(static_cast<std::size_t>(max_level) + 1)
+    {
+        for (std::size_t i = 0; i < m_lut.size(); ++i) {
+            double l = m_max_level ? 100.0 * i / m_max_level : 0.0;
+            m_lut[i] = static_cast<T>(std::lround(luminance(l) * m_max_level));
+        }
+    }
+
+    // Level for a lightness in [0, 1].
+    T level(double lightness) const
+    {
+        if (lightness <= 0.0)
+            return m_lut.front();
+        if (lightness >= 1.0)
+            return m_lut.back();
+        return m_lut[std::lround(lightness * m_max_level)];
+    }
+
+    // Lightness in [0, 1] of a level.
+    double lightness(T level) const
+    {
+        if (!m_max_level)
+            return 0.0;
+        double y = static_cast<double>(level) / m_max_level;
+        double l = y > 0.008856 ? 116.0 * std::cbrt(y) - 16.0 : 903.3 * y;
+        return l / 100.0;
+    }
+
+private:
+    // Relative luminance Y in [0, 1] for lightness L* in [0, 100].
+    static double luminance(double l)
+    {
+        if (l > 8.0) {
+            double f = (l + 16.0) / 116.0;
+            return f * f * f;
+        }
+        return l / 903.3;
+    }
+};
+
+/**
+ * @brief Commit b's pending level gradually over duration.
+ *
+ * The level moves linearly in lightness between the current and the
+ * pending level. Steps are paced by a timing::frame_clock at rate Hz
+ * and computed from their scheduled time, so if the embedded
+ * controller can't keep up, late steps are dropped instead of piling
+ * up and the fade still ends on time. Steps that don't change the
+ * level are never written.
+ *
+ * @returns Accumulated commit stats of every step.
+ **/
+template <typename T>
+fs::commit_stats fade(brightness<T> &b, std::chrono::milliseconds duration,
+                      unsigned rate = 60)
+{
+    if (!b.staged() || duration.count() <= 0)
+        return b.commit();
+
+    const T from = b.level();
+    const T to = b.pending_level();
+    if (from == to)
+        return b.commit();
+
+    const curve<T> c(b.max_level());
+    const double start = c.lightness(from);
+    const double end = c.lightness(to);
+    const double total = std::chrono::duration<double>(duration).count();
+
+    // SIGINT or SIGTERM cuts the fade short at its target.
+    fs::commit_stats stats;
+    timing::frame_clock clock(rate);
+    while (signals::running()) {
+        if (!clock.wait())
+            continue;
+
+        double t = std::chrono::duration<double>(clock.elapsed()).count();
+        if (t >= total)
+            break;
+
+        b.stage_value(c.level(start + (end - start) * (t / total)));
+        stats += b.commit();
+    }
+
+    b.stage_value(to);
+    stats += b.commit();
+    return stats;
+}
+
+/**
+ * @brief A fade driven by its owner's poll loop instead of blocking.
+ *
+ * Long-lived servers (the daemon, the HTTP server) can't sit in fade()
+ * while other clients and the Fn keys wait. A fader arms a
+ * CLOCK_MONOTONIC timerfd at rate Hz for as long as a fade runs; its
+ * owner polls fd() alongside everything else and calls step() when it
+ * is readable. Levels follow the same curve as fade(), computed from
+ * the elapsed time, so a loop that falls behind skips steps rather
+ * than stretching the fade. start() during a fade retargets it from
+ * the level it has reached.
+ **/
+template <typename T>
+class fader
+{
+private:
+    int m_fd = -1;
+    std::chrono::nanoseconds m_period;
+
+    std::optional<curve<T>> m_curve;
+    bool m_active = false;
+    double m_start = 0.0;
+    double m_end = 0.0;
+    T m_target = 0;
+    std::chrono::steady_clock::time_point m_began;
+    std::chrono::duration<double> m_duration{0};
+
+public:
+    // @throws std::system_error if the timerfd can't be created.
+    explicit fader(unsigned rate = 60)
+        : m_period(std::chrono::nanoseconds(1000000000ull / rate))
+    {
+        m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_fd == -1)
+            throw std::system_error(errno, std::generic_category(),
+                                    "timerfd_create");
+    }
+
+    ~fader(void)
+    {
+        close(m_fd);
+    }
+
+    fader(const fader &) = delete;
+    fader &operator=(const fader &) = delete;
+
+    // Readable whenever a step is due.
+    int fd(void) const
+    {
+        return m_fd;
+    }
+
+    bool active(void) const
+    {
+        return m_active;
+    }
+
+    // The level the fade in progress ends on.
+    T target(void) const
+    {
+        return m_target;
+    }
+
+    /**
+     * @brief Fade from b's current level to its pending one.
+     *
+     * Nothing happens without a pending level. A zero duration or a
+     * pending level equal to the current one commits it at once.
+     **/
+    fs::commit_stats start(brightness<T> &b,
+                           std::chrono::milliseconds duration)
+    {
+        if (!b.staged())
+            return {};
+
+        const T from = b.level();
+        const T to = b.pending_level();
+        if (duration.count() <= 0 || from == to) {
+            cancel();
+            return b.commit();
+        }
+
+        // Drop the pending level; the steps take it from here.
+        b.stage_trusted(from);
+        b.commit();
+
+        if (!m_curve)
+            m_curve.emplace(b.max_level());
+        m_start = m_curve->lightness(from);
+        m_end = m_curve->lightness(to);
+        m_target = to;
+        m_began = std::chrono::steady_clock::now();
+        m_duration = duration;
+        m_active = true;
+        arm(m_period);
+        return {};
+    }
+
+    /**
+     * @brief Commit the step that's due, once fd() is readable.
+     *
+     * The last step lands exactly on the target and stops the timer.
+     **/
+    fs::commit_stats step(brightness<T> &b)
+    {
+        uint64_t expirations;
+        if (read(m_fd, &expirations, sizeof(expirations)) == -1 ||
+            !m_active)
+            return {};
+
+        double t = (std::chrono::steady_clock::now() - m_began) / m_duration;
+        if (t >= 1.0) {
+            b.stage_value(m_target);
+            cancel();
+        } else {
+            b.stage_value(m_curve->level(m_start + (m_end - m_start) * t));
+        }
+        return b.commit();
+    }
+
+    // Stop where the fade has got to, e.g. when the Fn keys take over.
+    void cancel(void)
+    {
+        if (m_active) {
+            m_active = false;
+            arm(std::chrono::nanoseconds(0));
+        }
+    }
+
+private:
+    // Fire every period from now on; zero disarms.
+    void arm(std::chrono::nanoseconds period)
+    {
+        itimerspec spec{};
+        spec.it_value.tv_sec = period.count() / 1000000000;
+        spec.it_value.tv_nsec = period.count() % 1000000000;
+        spec.it_interval = spec.it_value;
+        timerfd_settime(m_fd, 0, &spec, nullptr);
+    }
+};
+
+}; // namespace led
+
+#endif /* FADE_HPP */
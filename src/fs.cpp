@@ -1,6 +1,14 @@
 #include "fs.hpp"
+#include "metrics.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/vfs.h>
+#include <system_error>
 #include <unistd.h>
 
+// From linux/magic.h.
+#define SYSFS_MAGIC 0x62656572
+
 bool fs::exists(const std::string &path)
 {
     return access(path.c_str(), F_OK) != -1;
@@ -8,5 +16,151 @@ bool fs::exists(const std::string &path)
 
 std::fstream fs::open(const std::string &path, std::ios::openmode modes)
 {
-    return std::fstream(path.c_str(), modes);
+    uint64_t started = metrics::now();
+    std::fstream fs(path.c_str(), modes);
+    metrics::record(metrics::lookup(path), metrics::op::open, started,
+                    fs.is_open());
+    return fs;
+}
+
+fs::node::node(std::string path)
+    : m_path(std::move(path))
+{
+}
+
+fs::node::~node(void)
+{
+    close();
+}
+
+fs::node::node(node &&other)
+    : m_path(std::move(other.m_path))
+    , m_fd(other.m_fd)
+    , m_writable(other.m_writable)
+    , m_truncate(other.m_truncate)
+    , m_metrics(other.m_metrics)
+{
+    other.m_fd = -1;
+}
+
+fs::node &fs::node::operator=(node &&other)
+{
+    if (this != &other) {
+        close();
+        m_path = std::move(other.m_path);
+        m_fd = other.m_fd;
+        m_writable = other.m_writable;
+        m_truncate = other.m_truncate;
+        m_metrics = other.m_metrics;
+        other.m_fd = -1;
+    }
+    return *this;
+}
+
+const std::string &fs::node::path(void) const
+{
+    return m_path;
+}
+
+std::size_t fs::node::read(char *buf, std::size_t size)
+{
+    if (m_fd == -1)
+        open(false);
+
+    uint64_t started = metrics::now();
+    ssize_t rc;
+    do {
+        rc = ::pread(m_fd, buf, size, 0);
+    } while (rc == -1 && errno == EINTR);
+
+    metrics::record(m_metrics, metrics::op::read, started, rc != -1);
+    if (rc == -1)
+        fail(errno);
+    return rc;
+}
+
+void fs::node::write(const char *buf, std::size_t size)
+{
+    int fd = write_fd();
+
+    uint64_t started = metrics::now();
+    ssize_t rc;
+    do {
+        rc = ::pwrite(fd, buf, size, 0);
+    } while (rc == -1 && errno == EINTR);
+
+    complete_write(rc == -1 ? -errno : rc, size, started);
+}
+
+int fs::node::write_fd(void)
+{
+    if (!m_writable)
+        open(true);
+    return m_fd;
+}
+
+void fs::node::complete_write(long rc, std::size_t size, uint64_t started)
+{
+    metrics::record(m_metrics, metrics::op::write, started,
+                    rc == static_cast<long>(size));
+    if (rc < 0)
+        fail(-rc);
+    if (static_cast<std::size_t>(rc) != size)
+        fail(EIO);
+
+    if (m_truncate && ::ftruncate(m_fd, size) == -1)
+        fail(errno);
+}
+
+int fs::node::fd(void)
+{
+    if (m_fd == -1)
+        open(false);
+    return m_fd;
+}
+
+void fs::node::close(void)
+{
+    if (m_fd != -1)
+        ::close(m_fd);
+    m_fd = -1;
+    m_writable = false;
+}
+
+void fs::node::open(bool writable)
+{
+    if (!m_metrics)
+        m_metrics = metrics::lookup(m_path);
+    uint64_t started = metrics::now();
+
+    // Prefer a read-write descriptor so one fd serves both directions;
+    // read-only attributes (and unprivileged readers) get O_RDONLY.
+    int fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    bool rw = fd != -1;
+    if (fd == -1 && !writable && (errno == EACCES || errno == EPERM))
+        fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        int error = errno;
+        metrics::record(m_metrics, metrics::op::open, started, false);
+        fail(error);
+    }
+
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) == -1) {
+        int error = errno;
+        ::close(fd);
+        metrics::record(m_metrics, metrics::op::open, started, false);
+        fail(error);
+    }
+    metrics::record(m_metrics, metrics::op::open, started, true);
+
+    close();
+    m_fd = fd;
+    m_writable = rw;
+    m_truncate = sfs.f_type != SYSFS_MAGIC;
+}
+
+void fs::node::fail(int error) const
+{
+    throw std::system_error(error, std::generic_category(), m_path);
 }
@@ -1,6 +1,8 @@
 #ifndef FS_HPP
 #define FS_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <string>
 
@@ -12,6 +14,11 @@
 #define JOIN(a, b) a b
 #endif
 
+namespace metrics
+{
+struct file;
+}; // namespace metrics
+
 namespace fs
 {
 
@@ -36,6 +43,114 @@ bool exists(const std::string &path);
  **/
 std::fstream open(const std::string &path, std::ios::openmode modes);
 
+/**
+ * @brief Outcome of committing staged attribute values.
+ **/
+struct commit_stats {
+    // Attributes that were actually written.
+    std::size_t written = 0;
+
+    // Staged attributes that already held the staged value.
+    std::size_t skipped = 0;
+
+    commit_stats &operator+=(const commit_stats &other)
+    {
+        written += other.written;
+        skipped += other.skipped;
+        return *this;
+    }
+};
+
+/**
+ * @brief A persistent handle on a single sysfs attribute.
+ *
+ * The attribute is opened on first use and the descriptor is kept for
+ * the lifetime of the node; every read and write afterwards is a single
+ * pread(2)/pwrite(2) at offset 0, which is how sysfs expects attributes
+ * to be accessed. No buffering or allocation happens per call.
+ *
+ * Failures throw std::system_error carrying the errno of the failing
+ * call, with the attribute path as its message.
+ *
+ * Opens, reads and writes are timed into the attribute's entry in the
+ * metrics table, which is looked up on first open.
+ **/
+class node
+{
+private:
+    std::string m_path;
+    int m_fd = -1;
+    bool m_writable = false;
+
+    // Writes to a regular file (a fake tree, not sysfs) must also
+    // truncate, otherwise a shorter value leaves stale bytes behind.
+    bool m_truncate = false;
+
+    metrics::file *m_metrics = nullptr;
+
+public:
+    explicit node(std::string path);
+    ~node(void);
+
+    node(const node &) = delete;
+    node &operator=(const node &) = delete;
+
+    node(node &&other);
+    node &operator=(node &&other);
+
+    const std::string &path(void) const;
+
+    /**
+     * @brief Read the attribute's current contents into buf.
+     *
+     * @param buf Destination buffer.
+     * @param size Size of buf in bytes.
+     * @returns Number of bytes read.
+     **/
+    std::size_t read(char *buf, std::size_t size);
+
+    /**
+     * @brief Replace the attribute's contents with buf.
+     *
+     * @param buf Source buffer.
+     * @param size Number of bytes in buf to write.
+     **/
+    void write(const char *buf, std::size_t size);
+
+    /**
+     * @brief The node's descriptor, opened for writing if needed.
+     *
+     * For callers that submit writes themselves (see fs::batch); they
+     * must report the outcome through complete_write().
+     **/
+    int write_fd(void);
+
+    /**
+     * @brief Check the outcome of a write of size bytes.
+     *
+     * @param rc Bytes written, or a negated errno.
+     * @param started metrics::now() when the write was submitted.
+     * @throws std::system_error if the write failed or was short.
+     **/
+    void complete_write(long rc, std::size_t size, uint64_t started);
+
+    /**
+     * @brief The node's descriptor, opening it for reading if needed.
+     *
+     * Meant for adding the node to a poll set; don't close it.
+     **/
+    int fd(void);
+
+    /**
+     * @brief Close the descriptor; the next access reopens it.
+     **/
+    void close(void);
+
+private:
+    void open(bool writable);
+    [[noreturn]] void fail(int error) const;
+};
+
 }; // namespace fs
 
 #endif /* FS_HPP */
@@ -0,0 +1,930 @@
+#include "http.hpp"
+#include "app.hpp"
+#include "color/hex.hpp"
+#include "logging.hpp"
+#include "signals.hpp"
+#include "watcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// How long the server may sit on unsaved state.
+static constexpr std::chrono::seconds flush_interval(1);
+
+// How long an idle keep-alive connection is held open.
+static constexpr std::chrono::seconds idle_timeout(30);
+
+// Largest request head buffered before the client is turned away.
+static constexpr std::size_t max_head = 8192;
+
+// Largest request body accepted; the API never needs one.
+static constexpr std::size_t max_body = 8192;
+
+// Input buffered per connection: one whole request. Pipelined ones
+// past it wait in the socket.
+static constexpr std::size_t max_input = max_head + 4 + max_body;
+
+// Requests queued per connection for one batch; the rest stay buffered
+// until its responses are out.
+static constexpr std::size_t max_calls = 64;
+
+namespace http
+{
+
+// One parsed request, answered once the batch it arrived in is applied.
+struct call {
+    enum kind {
+        get_colors,
+        put_colors,
+        get_brightness,
+        put_brightness,
+        preflight,
+        asset,
+        bad_request,
+        not_found,
+        bad_method,
+    };
+
+    kind what = not_found;
+    bool keep_alive = true;
+
+    // put_colors: the app::request region flags and their color.
+    uint32_t regions = 0;
+    char color[6] = {};
+
+    // put_brightness: exactly one of these.
+    std::optional<int32_t> level;
+    std::optional<int32_t> delta;
+
+    // put_brightness: fade to the new level over this long.
+    uint32_t fade_ms = 0;
+
+    // asset: request path; bad_request: optional JSON message.
+    std::string path;
+    const char *message = nullptr;
+};
+
+struct connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    std::size_t sent = 0;
+    std::vector<call> calls;
+
+    // Close once out has been written; no more requests are read.
+    bool closing = false;
+
+    // The peer has stopped sending; close once what it sent is answered.
+    bool eof = false;
+
+    // Events c is registered for, and whether calls of c are queued in
+    // the current batch.
+    uint32_t events = EPOLLIN;
+    bool ready = false;
+
+    clock_type::time_point active;
+};
+
+class server
+{
+private:
+    int m_epoll = -1;
+    int m_listen = -1;
+    std::string m_root;
+    app::state &m_state;
+    std::optional<led::hw_watcher> m_watcher;
+
+    std::unordered_map<int, connection> m_connections;
+    std::vector<connection *> m_ready;
+
+public:
+    server(int sock, std::string root, app::state &st);
+    ~server(void);
+
+    server(const server &) = delete;
+    server &operator=(const server &) = delete;
+
+    void run(void);
+
+private:
+    void accept_all(void);
+    void on_readable(connection &c);
+    void take(connection &c);
+    void apply(void);
+    void respond(connection &c, const call &k, const app::response &res);
+    void serve_file(connection &c, const call &k);
+    void flush(connection &c);
+    void close(connection &c);
+    void sweep(clock_type::time_point now);
+    void step_fade(void);
+};
+
+}; // namespace http
+
+using namespace http;
+
+static const std::pair<std::string_view, app::request::flag> regions[] = {
+    {"left", app::request::left},
+    {"center", app::request::center},
+    {"right", app::request::right},
+    {"extra", app::request::extra}};
+
+static bool iequals(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return tolower(static_cast<unsigned char>(x)) ==
+                      tolower(static_cast<unsigned char>(y));
+           });
+}
+
+static bool icontains(std::string_view s, std::string_view token)
+{
+    for (std::size_t i = 0; i + token.size() <= s.size(); ++i) {
+        if (iequals(s.substr(i, token.size()), token))
+            return true;
+    }
+    return false;
+}
+
+// Value of key in a query string; empty if it isn't there.
+static std::string_view query_value(std::string_view query,
+                                    std::string_view key)
+{
+    while (!query.empty()) {
+        auto end = query.find('&');
+        auto pair = query.substr(0, end);
+        auto eq = pair.find('=');
+        if (eq != std::string_view::npos && pair.substr(0, eq) == key)
+            return pair.substr(eq + 1);
+        if (end == std::string_view::npos)
+            break;
+        query.remove_prefix(end + 1);
+    }
+    return {};
+}
+
+static std::optional<int32_t> to_int(std::string_view s)
+{
+    int32_t value;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (s.empty() || ec != std::errc() || end != s.data() + s.size())
+        return std::nullopt;
+    return value;
+}
+
+// a + b, clamped to the range of int32_t.
+static int32_t add(int32_t a, int32_t b)
+{
+    int64_t sum = int64_t(a) + b;
+    return std::clamp<int64_t>(sum, std::numeric_limits<int32_t>::min(),
+                               std::numeric_limits<int32_t>::max());
+}
+
+static call route(std::string_view method, std::string_view target,
+                  const std::string &root)
+{
+    call k;
+    auto q = target.find('?');
+    auto path = target.substr(0, q);
+    auto query = q == std::string_view::npos ? std::string_view()
+                                             : target.substr(q + 1);
+
+    if (method == "OPTIONS") {
+        k.what = call::preflight;
+        return k;
+    }
+
+    if (path == "/colors" || path.substr(0, 8) == "/colors/") {
+        if (method == "GET" && path == "/colors") {
+            k.what = call::get_colors;
+            return k;
+        }
+        if (method != "PUT") {
+            k.what = call::bad_method;
+            return k;
+        }
+
+        k.what = call::bad_request;
+        auto value = query_value(query, "color");
+        if (!color::hex::decode(value))
+            return k;
+        memcpy(k.color, value.data(), sizeof(k.color));
+
+        if (path == "/colors") {
+            k.regions = app::request::left | app::request::center |
+                        app::request::right;
+        } else {
+            auto name = path.substr(8);
+            for (auto [region, flag] : regions) {
+                if (name == region)
+                    k.regions = flag;
+            }
+            if (!k.regions) {
+                k.message = "Incorrect 'region' parameter.";
+                return k;
+            }
+        }
+        k.what = call::put_colors;
+        return k;
+    }
+
+    if (path == "/brightness") {
+        if (method == "GET") {
+            k.what = call::get_brightness;
+        } else if (method == "PUT") {
+            k.level = to_int(query_value(query, "level"));
+            if (!k.level)
+                k.delta = to_int(query_value(query, "increment"));
+            auto fade = to_int(query_value(query, "fade_ms"));
+            if (fade && *fade > 0)
+                k.fade_ms = *fade;
+            k.what = k.level || k.delta ? call::put_brightness
+                                        : call::bad_request;
+        } else {
+            k.what = call::bad_method;
+        }
+        return k;
+    }
+
+    if (method == "GET" && !root.empty()) {
+        k.what = call::asset;
+        k.path = std::string(path);
+    }
+    return k;
+}
+
+// Turn the complete requests buffered on c into calls. Returns false if
+// the stream can't be parsed.
+static bool parse(connection &c, const std::string &root)
+{
+    std::size_t pos = 0;
+    bool ok = true;
+    while (!c.closing && c.calls.size() < max_calls) {
+        auto end = c.in.find("\r\n\r\n", pos);
+        if (end == std::string::npos) {
+            ok = c.in.size() - pos <= max_head;
+            break;
+        }
+
+        std::string_view head(c.in.data() + pos, end - pos);
+        auto line_end = head.find("\r\n");
+        auto line = head.substr(0, line_end);
+        auto sp1 = line.find(' ');
+        auto sp2 = line.rfind(' ');
+        if (sp1 == std::string_view::npos || sp1 == sp2) {
+            ok = false;
+            break;
+        }
+        auto method = line.substr(0, sp1);
+        auto target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        auto version = line.substr(sp2 + 1);
+
+        bool keep_alive = version == "HTTP/1.1";
+        std::optional<std::size_t> length;
+        while (ok && line_end != std::string_view::npos) {
+            head.remove_prefix(line_end + 2);
+            line_end = head.find("\r\n");
+            auto header = head.substr(0, line_end);
+            auto colon = header.find(':');
+            if (colon == std::string_view::npos)
+                continue;
+
+            auto name = header.substr(0, colon);
+            auto value = header.substr(colon + 1);
+            while (!value.empty() && value.front() == ' ')
+                value.remove_prefix(1);
+            if (iequals(name, "Content-Length")) {
+                // One length, and no body larger than a head.
+                auto n = to_int(value);
+                ok = !length && n && *n >= 0 &&
+                     static_cast<std::size_t>(*n) <= max_body;
+                length = n.value_or(0);
+            } else if (iequals(name, "Transfer-Encoding")) {
+                ok = false;
+            } else if (iequals(name, "Connection")) {
+                if (icontains(value, "close"))
+                    keep_alive = false;
+                else if (icontains(value, "keep-alive"))
+                    keep_alive = true;
+            }
+        }
+        if (!ok)
+            break;
+
+        // Bodies aren't used, but have to be skipped over.
+        auto body = end + 4;
+        if (c.in.size() - body < length.value_or(0))
+            break;
+
+        c.calls.push_back(route(method, target, root));
+        c.calls.back().keep_alive = keep_alive;
+        c.closing = !keep_alive;
+        pos = body + length.value_or(0);
+    }
+
+    c.in.erase(0, pos);
+    return ok;
+}
+
+static const char *reason(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+static void reply(connection &c, int status, std::string_view type,
+                  std::string_view body, bool keep_alive,
+                  std::string_view headers = {})
+{
+    auto &out = c.out;
+    out += "HTTP/1.1 ";
+    out += std::to_string(status);
+    out += ' ';
+    out += reason(status);
+    out += "\r\nContent-Length: ";
+    out += std::to_string(body.size());
+    if (!type.empty()) {
+        out += "\r\nContent-Type: ";
+        out += type;
+    }
+    out += "\r\nAccess-Control-Allow-Origin: *\r\n";
+    out += headers;
+    out += keep_alive ? "Connection: keep-alive\r\n\r\n"
+                      : "Connection: close\r\n\r\n";
+    out += body;
+}
+
+static void reply_json(connection &c, int status, std::string_view body,
+                       bool keep_alive)
+{
+    reply(c, status, "application/json", body, keep_alive);
+}
+
+static std::string status_json(int status, std::string_view message)
+{
+    std::string body = "{\"status\":" + std::to_string(status) +
+                       ",\"message\":\"";
+    for (char ch : message) {
+        if (ch == '"' || ch == '\\')
+            body += '\\';
+        body += ch;
+    }
+    return body + "\"}";
+}
+
+static std::string_view content_type(std::string_view path)
+{
+    static const std::pair<std::string_view, std::string_view> types[] = {
+        {".html", "text/html; charset=utf-8"},
+        {".js", "application/javascript"},
+        {".css", "text/css"},
+        {".json", "application/json"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".ico", "image/x-icon"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".map", "application/json"},
+    };
+    for (auto [ext, type] : types) {
+        if (path.size() >= ext.size() &&
+            path.substr(path.size() - ext.size()) == ext)
+            return type;
+    }
+    return "application/octet-stream";
+}
+
+server::server(int sock, std::string root, app::state &st)
+    : m_listen(sock)
+    , m_root(std::move(root))
+    , m_state(st)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll == -1)
+        throw std::system_error(errno, std::generic_category(),
+                                "epoll_create1");
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_listen;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listen, &ev);
+
+    // Follow Fn key changes as they happen, like the daemon.
+    try {
+        m_watcher.emplace();
+        ev.events = EPOLLPRI | EPOLLERR;
+        ev.data.fd = m_watcher->fd();
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, ev.data.fd, &ev);
+    } catch (std::system_error &e) {
+        logging::warn("Not tracking hardware brightness:", e.what());
+    }
+
+    if (m_state.fader) {
+        ev.events = EPOLLIN;
+        ev.data.fd = m_state.fader->fd();
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, ev.data.fd, &ev);
+    }
+}
+
+server::~server(void)
+{
+    for (auto &entry : m_connections)
+        ::close(entry.first);
+    ::close(m_epoll);
+}
+
+void server::run(void)
+{
+    std::optional<clock_type::time_point> flush_at;
+    epoll_event events[64];
+
+    while (signals::running()) {
+        // Wake up for the next flush, and now and then to drop idle
+        // connections while there are any.
+        int timeout = m_connections.empty() ? -1 : 1000;
+        if (!m_ready.empty())
+            timeout = 0;
+        if (flush_at) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                *flush_at - clock_type::now());
+            int limit = timeout == -1 ? std::numeric_limits<int>::max()
+                                      : timeout;
+            timeout = std::clamp<int>(left.count(), 0, limit);
+        }
+
+        int n = epoll_wait(m_epoll, events, std::size(events), timeout);
+        auto now = clock_type::now();
+        if (flush_at && now >= *flush_at) {
+            try {
+                m_state.cache.file.flush();
+            } catch (std::system_error &e) {
+                logging::error("Unable to save state:", e.what());
+            }
+            flush_at.reset();
+        }
+        if (n == -1 && errno != EINTR)
+            logging::error("epoll_wait() failed:", strerror(errno));
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == m_listen) {
+                accept_all();
+                continue;
+            }
+            if (m_watcher && fd == m_watcher->fd()) {
+                if (auto level = m_watcher->consume())
+                    app::on_hw_changed(m_state, *level);
+                continue;
+            }
+            if (m_state.fader && fd == m_state.fader->fd()) {
+                step_fade();
+                continue;
+            }
+
+            auto it = m_connections.find(fd);
+            if (it == m_connections.end())
+                continue;
+            auto &c = it->second;
+            c.active = now;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                on_readable(c);
+            else if (events[i].events & EPOLLOUT)
+                flush(c);
+        }
+
+        // Everything that arrived since the last batch goes out as one.
+        if (!m_ready.empty())
+            apply();
+
+        sweep(now);
+        if (m_state.cache.file.dirty() && !flush_at)
+            flush_at = clock_type::now() + flush_interval;
+    }
+}
+
+void server::accept_all(void)
+{
+    for (;;) {
+        int fd = accept4(m_listen, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                logging::error("accept() failed:", strerror(errno));
+            return;
+        }
+
+        // Responses are small and latency is what matters.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            ::close(fd);
+            continue;
+        }
+
+        auto &c = m_connections[fd];
+        c.fd = fd;
+        c.active = clock_type::now();
+    }
+}
+
+void server::on_readable(connection &c)
+{
+    bool open = true;
+    char buf[4096];
+    while (c.in.size() < max_input) {
+        ssize_t rc = ::read(c.fd, buf, sizeof(buf));
+        if (rc > 0) {
+            if (!c.closing)
+                c.in.append(buf, rc);
+            continue;
+        }
+        if (rc == -1 && errno == EINTR)
+            continue;
+        open = rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        break;
+    }
+
+    take(c);
+    if (!open) {
+        c.eof = true;
+        if (!c.ready)
+            flush(c);
+    }
+}
+
+void server::take(connection &c)
+{
+    std::size_t queued = c.calls.size();
+    if (!c.closing && !parse(c, m_root)) {
+        call k;
+        k.what = call::bad_request;
+        k.keep_alive = false;
+        c.calls.push_back(k);
+        c.closing = true;
+    }
+
+    if (c.calls.size() > queued && !c.ready) {
+        c.ready = true;
+        m_ready.push_back(&c);
+    }
+}
+
+void server::apply(void)
+{
+    // Fold every PUT of the batch into a single request, in arrival
+    // order: later colors win, and increments add up.
+    app::request req;
+    req.flags = app::request::quiet;
+    bool needed = false;
+    std::size_t puts = 0;
+
+    // Connections flushed below may queue their next requests.
+    auto ready = std::move(m_ready);
+    m_ready.clear();
+    for (auto *c : ready) {
+        for (auto &k : c->calls) {
+            switch (k.what) {
+            case call::put_colors:
+                for (std::size_t i = 0; i < std::size(regions); ++i) {
+                    if (k.regions & regions[i].second)
+                        memcpy(req.colors[i], k.color, sizeof(k.color));
+                }
+                req.flags |= k.regions;
+                needed = true;
+                ++puts;
+                break;
+            case call::put_brightness:
+                if (k.level) {
+                    req.flags |= app::request::brightness;
+                    req.flags &= ~app::request::increment;
+                    req.level = *k.level;
+                    req.delta = 0;
+                } else if (req.has(app::request::brightness)) {
+                    req.level = add(req.level, *k.delta);
+                } else {
+                    req.flags |= app::request::increment;
+                    req.delta = add(req.delta, *k.delta);
+                }
+                req.fade_ms = std::max(req.fade_ms, k.fade_ms);
+                needed = true;
+                ++puts;
+                break;
+            case call::get_colors:
+            case call::get_brightness:
+                req.flags &= ~app::request::quiet;
+                needed = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    app::response res;
+    if (needed) {
+        // Without a watcher, the firmware may have changed brightness
+        // since the last batch.
+        if (!m_watcher)
+            m_state.brightness.reload();
+        try {
+            res = app::run(m_state, req);
+        } catch (std::exception &e) {
+            res = app::response();
+            res.status = 1;
+            strncpy(res.error, e.what(), sizeof(res.error) - 1);
+        }
+        if (puts > 1)
+            logging::debug("Coalesced", puts, " PUTs into one commit.");
+    }
+
+    for (auto *c : ready) {
+        for (auto &k : c->calls)
+            respond(*c, k, res);
+        c->calls.clear();
+        c->ready = false;
+        flush(*c);
+    }
+}
+
+void server::step_fade(void)
+{
+    try {
+        m_state.fader->step(m_state.brightness);
+    } catch (std::system_error &e) {
+        logging::error("Fade step failed:", e.what());
+        m_state.fader->cancel();
+        m_state.brightness.reload();
+    }
+}
+
+void server::respond(connection &c, const call &k,
+                     const app::response &res)
+{
+    const bool keep = k.keep_alive;
+    if (res.status && (k.what == call::get_colors ||
+                       k.what == call::put_colors ||
+                       k.what == call::get_brightness ||
+                       k.what == call::put_brightness)) {
+        reply_json(c, 500, status_json(500, res.error), keep);
+        return;
+    }
+
+    switch (k.what) {
+    case call::get_colors: {
+        std::string body = "{";
+        for (std::size_t i = 0; i < std::size(regions); ++i) {
+            body += i ? ",\"" : "\"";
+            body += regions[i].first;
+            body += "\":\"";
+            body.append(res.colors[i], sizeof(res.colors[i]));
+            body += '"';
+        }
+        reply_json(c, 200, body + "}", keep);
+        break;
+    }
+    case call::get_brightness:
+        reply_json(c, 200,
+                   "{\"level\":" + std::to_string(res.level) +
+                       ",\"max_level\":" + std::to_string(res.max_level) +
+                       "}",
+                   keep);
+        break;
+    case call::put_colors:
+    case call::put_brightness:
+        reply_json(c, 200, status_json(200, "OK"), keep);
+        break;
+    case call::preflight:
+        reply(c, 204, {}, {}, keep,
+              "Access-Control-Allow-Methods: GET, PUT, OPTIONS\r\n"
+              "Access-Control-Allow-Headers: Content-Type\r\n");
+        break;
+    case call::asset:
+        serve_file(c, k);
+        break;
+    case call::bad_request:
+        reply_json(c, 400, k.message ? status_json(400, k.message) : "{}",
+                   keep);
+        break;
+    case call::bad_method:
+        reply_json(c, 405, "{}", keep);
+        break;
+    case call::not_found:
+        reply_json(c, 404, "{}", keep);
+        break;
+    }
+}
+
+void server::serve_file(connection &c, const call &k)
+{
+    std::string path = k.path == "/" ? "/index.html" : k.path;
+    int fd = -1;
+    if (path.find("..") == std::string::npos)
+        fd = ::open((m_root + path).c_str(), O_RDONLY | O_CLOEXEC);
+
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        if (fd != -1)
+            ::close(fd);
+        reply_json(c, 404, "{}", k.keep_alive);
+        return;
+    }
+
+    std::string body(st.st_size, '\0');
+    std::size_t n = 0;
+    while (n < body.size()) {
+        ssize_t rc = ::read(fd, body.data() + n, body.size() - n);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            break;
+        n += rc;
+    }
+    ::close(fd);
+    body.resize(n);
+    reply(c, 200, content_type(path), body, k.keep_alive);
+}
+
+void server::flush(connection &c)
+{
+    while (c.sent < c.out.size()) {
+        ssize_t rc = ::send(c.fd, c.out.data() + c.sent,
+                            c.out.size() - c.sent, MSG_NOSIGNAL);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (rc <= 0) {
+            close(c);
+            return;
+        }
+        c.sent += rc;
+    }
+
+    bool pending = c.sent < c.out.size();
+    if (!pending) {
+        c.out.clear();
+        c.sent = 0;
+
+        // Requests held back by max_calls go in the next batch.
+        if (!c.ready && !c.in.empty())
+            take(c);
+        if (!c.ready && (c.closing || c.eof)) {
+            close(c);
+            return;
+        }
+    }
+
+    // Only ask for EPOLLOUT while a response is stuck in the socket.
+    // Reading pauses meanwhile, so a client that never reads can't
+    // pile up responses, and stops for good once it's on its way out.
+    uint32_t events = 0;
+    if (!pending && !c.closing && !c.eof)
+        events |= EPOLLIN;
+    if (pending)
+        events |= EPOLLOUT;
+    if (events != c.events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = c.fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+        c.events = events;
+    }
+}
+
+void server::close(connection &c)
+{
+    // Calls queued in this batch still refer to c; apply() closes it.
+    if (c.ready)
+        return;
+    ::close(c.fd);
+    m_connections.erase(c.fd);
+}
+
+void server::sweep(clock_type::time_point now)
+{
+    std::vector<connection *> idle;
+    for (auto &entry : m_connections) {
+        auto &c = entry.second;
+        if (now - c.active > idle_timeout && c.calls.empty())
+            idle.push_back(&c);
+    }
+    for (auto *c : idle)
+        close(*c);
+}
+
+// Bind a listening socket for "[address:]port".
+static int listen_on(const std::string &address)
+{
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    auto colon = address.rfind(':');
+    if (colon != std::string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo *info = nullptr;
+    int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                         &hints, &info);
+    if (rc) {
+        logging::error("Invalid address", address + ":", gai_strerror(rc));
+        return -1;
+    }
+
+    int sock = -1;
+    for (auto *ai = info; ai && sock == -1; ai = ai->ai_next) {
+        sock = socket(ai->ai_family,
+                      ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      ai->ai_protocol);
+        if (sock == -1)
+            continue;
+
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(sock, ai->ai_addr, ai->ai_addrlen) == -1 ||
+            listen(sock, 64) == -1) {
+            ::close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(info);
+
+    if (sock == -1)
+        logging::error("Unable to listen on", address + ":",
+                       strerror(errno));
+    return sock;
+}
+
+int http::serve(const std::string &address, const std::string &root,
+                fs::batch::backend backend)
+{
+    if (!app::ensure_cache_dir()) {
+        logging::error("mkdir() failed on:", CACHE_PREFIX);
+        return 1;
+    }
+
+    int sock = listen_on(address);
+    if (sock == -1)
+        return 1;
+
+    signals::install();
+    try {
+        app::state st(led::default_device());
+        st.batch.select(backend);
+        st.fader.emplace();
+
+        server srv(sock, root, st);
+        logging::info("Serving HTTP on", address);
+        srv.run();
+        st.cache.file.flush();
+    } catch (std::exception &e) {
+        logging::error(e.what());
+        ::close(sock);
+        return 1;
+    }
+
+    ::close(sock);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef HTTP_HPP
+#define HTTP_HPP
+
+#include "batch.hpp"
+#include <string>
+
+namespace http
+{
+
+/**
+ * @brief Serve the web API over HTTP/1.1 until SIGINT or SIGTERM.
+ *
+ * Endpoints, answering with JSON the way the old Node API did:
+ *
+ *   GET /colors                      {"left": "rrggbb", ...}
+ *   PUT /colors?color=rrggbb         left, center and right
+ *   PUT /colors/:region?color=rrggbb one region
+ *   GET /brightness                  {"level": n, "max_level": n}
+ *   PUT /brightness?level=n          or ?increment=n
+ *
+ * Everything runs on one epoll loop over non-blocking sockets, and
+ * connections are kept alive. Requests that arrive while the previous
+ * batch is being written are applied together: a burst of PUTs (a
+ * color picker being dragged) becomes one app::run and one commit.
+ * Like the daemon, the keyboard state is kept for the server's
+ * lifetime.
+ *
+ * @param address Port to listen on, optionally prefixed with an
+ *        address ("8000", "0.0.0.0:8000"); loopback by default.
+ * @param root Directory of static files served for any other GET, e.g.
+ *        the built web UI; empty to serve the API only.
+ * @param backend How the attribute writes of a batch are submitted.
+ * @returns Process exit code.
+ **/
+int serve(const std::string &address, const std::string &root,
+          fs::batch::backend backend = fs::batch::backend::pwrite);
+
+}; // namespace http
+
+#endif /* HTTP_HPP */
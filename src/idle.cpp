@@ -0,0 +1,369 @@
+#include "idle.hpp"
+#include "fade.hpp"
+#include "logging.hpp"
+#include "signals.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace idle;
+
+// Steps of a dimming fade per second.
+static constexpr unsigned fade_rate = 30;
+
+// epoll data of the timer; sources use their index.
+static constexpr uint64_t timer_id = std::numeric_limits<uint64_t>::max();
+
+static constexpr std::size_t long_bits = sizeof(unsigned long) * 8;
+
+static bool has(const unsigned long *bits, unsigned bit)
+{
+    return bits[bit / long_bits] >> (bit % long_bits) & 1;
+}
+
+bool idle::interactive(int fd)
+{
+    unsigned long types[EV_MAX / long_bits + 1] = {};
+    unsigned long keys[KEY_MAX / long_bits + 1] = {};
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) == -1)
+        return false;
+    if (has(types, EV_KEY))
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+
+    const bool keyboard = has(keys, KEY_SPACE);
+    const bool pointer = has(types, EV_REL) || has(keys, BTN_LEFT) ||
+                         has(keys, BTN_TOUCH);
+    return keyboard || pointer;
+}
+
+std::vector<std::string> idle::discover(const std::string &path)
+{
+    std::vector<std::string> paths;
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return paths;
+
+    while (auto *entry = readdir(dir)) {
+        std::string_view name(entry->d_name);
+        if (name.substr(0, 5) != "event")
+            continue;
+
+        auto device = path + entry->d_name;
+        int fd = ::open(device.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            logging::debug("Skipping", device, strerror(errno));
+            continue;
+        }
+        if (interactive(fd))
+            paths.push_back(std::move(device));
+        ::close(fd);
+    }
+    closedir(dir);
+
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+static std::chrono::nanoseconds now(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::chrono::seconds(ts.tv_sec) +
+           std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+static timespec to_timespec(std::chrono::nanoseconds ns)
+{
+    timespec ts;
+    ts.tv_sec = ns.count() / 1000000000;
+    ts.tv_nsec = ns.count() % 1000000000;
+    return ts;
+}
+
+monitor::monitor(void)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll == -1)
+        throw std::system_error(errno, std::generic_category(),
+                                "epoll_create1");
+
+    m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timer == -1) {
+        int error = errno;
+        ::close(m_epoll);
+        throw std::system_error(error, std::generic_category(),
+                                "timerfd_create");
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = timer_id;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &ev);
+}
+
+monitor::~monitor(void)
+{
+    for (std::size_t i = 0; i < m_sources.size(); ++i)
+        remove(i);
+    ::close(m_timer);
+    ::close(m_epoll);
+}
+
+void monitor::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+        throw std::system_error(errno, std::generic_category(), path);
+    add(fd, true);
+}
+
+void monitor::add(int fd, bool owned)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = m_sources.size();
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        int error = errno;
+        if (owned)
+            ::close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "epoll_ctl");
+    }
+
+    source s;
+    s.fd = fd;
+    s.owned = owned;
+    m_sources.push_back(s);
+    ++m_open;
+}
+
+std::size_t monitor::size(void) const
+{
+    return m_open;
+}
+
+void monitor::remove(std::size_t i)
+{
+    auto &s = m_sources[i];
+    if (s.fd == -1)
+        return;
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, s.fd, nullptr);
+    if (s.owned)
+        ::close(s.fd);
+    s.fd = -1;
+    --m_open;
+}
+
+bool monitor::drain(std::size_t i, stats &st)
+{
+    auto &s = m_sources[i];
+    bool input = false;
+
+    // evdev hands out whole records; a pipe may split them.
+    char buf[64 * sizeof(input_event)];
+    while (true) {
+        std::memcpy(buf, s.buffer, s.partial);
+        ssize_t n = read(s.fd, buf + s.partial, sizeof(buf) - s.partial);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+            return input;
+        if (n <= 0) {
+            // End of file, or the device was unplugged.
+            remove(i);
+            return input;
+        }
+
+        std::size_t total = s.partial + n;
+        std::size_t whole = total - total % sizeof(input_event);
+        for (std::size_t off = 0; off < whole; off += sizeof(input_event)) {
+            input_event ev;
+            std::memcpy(&ev, buf + off, sizeof(ev));
+            if (ev.type == EV_KEY || ev.type == EV_REL ||
+                ev.type == EV_ABS) {
+                ++st.events;
+                input = true;
+            }
+        }
+        s.partial = total - whole;
+        std::memcpy(s.buffer, buf + whole, s.partial);
+    }
+}
+
+void monitor::arm(std::chrono::nanoseconds at,
+                  std::chrono::nanoseconds period)
+{
+    itimerspec spec{};
+    spec.it_value = to_timespec(at);
+    spec.it_interval = to_timespec(period);
+    if (timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr) == -1)
+        throw std::system_error(errno, std::generic_category(),
+                                "timerfd_settime");
+}
+
+// One keyboard's side of a dim.
+struct dimmer {
+    bool dimmed = false;
+    uint32_t from = 0;
+    uint32_t written = 0;
+    std::optional<led::curve<uint32_t>> curve;
+};
+
+// Save the level st is about to be dimmed from; false if it's already
+// at or below c.level.
+static bool begin(app::state &st, dimmer &d, const config &c)
+{
+    // The Fn keys may have changed it since we last looked.
+    st.brightness.reload();
+    auto level = st.brightness.level();
+    d.dimmed = level > c.level;
+    if (!d.dimmed)
+        return false;
+
+    if (st.cache.brightness.data() != level) {
+        st.cache.brightness.set_data(level);
+        st.cache.file.flush();
+    }
+    d.from = d.written = level;
+    if (!d.curve)
+        d.curve.emplace(st.brightness.max_level());
+    return true;
+}
+
+// Move st a fraction t of the way down, in lightness.
+static void step(app::state &st, dimmer &d, const config &c, double t)
+{
+    if (!d.dimmed)
+        return;
+    const double start = d.curve->lightness(d.from);
+    const double end = d.curve->lightness(c.level);
+    st.brightness.stage_value(t >= 1.0 ? c.level
+                                       : d.curve->level(start +
+                                                        (end - start) * t));
+    st.brightness.commit();
+    d.written = st.brightness.level();
+}
+
+// Bring st back to the cached level; false if it wasn't dimmed or was
+// changed by someone else since.
+static bool restore(app::state &st, dimmer &d)
+{
+    if (!d.dimmed)
+        return false;
+    d.dimmed = false;
+
+    st.brightness.reload();
+    if (st.brightness.level() != d.written) {
+        logging::debug("Brightness changed while idle; not restoring.");
+        return false;
+    }
+    st.brightness.stage_trusted(st.cache.brightness.data().value_or(d.from));
+    st.brightness.commit();
+    return true;
+}
+
+stats monitor::run(std::deque<app::state> &states, const config &c)
+{
+    signals::install();
+
+    enum class phase { active, fading, dimmed };
+    auto current = phase::active;
+    std::vector<dimmer> dimmers(states.size());
+    const std::chrono::nanoseconds period(1000000000 / fade_rate);
+
+    auto restore_all = [&](stats &s) {
+        bool any = false;
+        for (std::size_t i = 0; i < states.size(); ++i)
+            any |= restore(states[i], dimmers[i]);
+        if (any)
+            ++s.restores;
+    };
+
+    stats s;
+    auto last = now();
+    auto fade_start = last;
+    arm(last + c.timeout);
+
+    epoll_event events[16];
+    while (signals::running() && m_open) {
+        int n = epoll_wait(m_epoll, events, std::size(events), -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(),
+                                    "epoll_wait");
+        }
+
+        bool input = false, expired = false;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == timer_id) {
+                uint64_t expirations;
+                expired |= read(m_timer, &expirations,
+                                sizeof(expirations)) > 0;
+            } else {
+                input |= drain(events[i].data.u64, s);
+            }
+        }
+
+        const auto t = now();
+        if (input) {
+            last = t;
+            if (current != phase::active) {
+                restore_all(s);
+                current = phase::active;
+                arm(last + c.timeout);
+            }
+        }
+        if (!expired)
+            continue;
+
+        if (current == phase::active) {
+            // Input since the timer was armed moved the deadline.
+            if (t - last < c.timeout) {
+                arm(last + c.timeout);
+                continue;
+            }
+
+            bool any = false;
+            for (std::size_t i = 0; i < states.size(); ++i)
+                any |= begin(states[i], dimmers[i], c);
+            if (!any) {
+                // Nothing to dim; sleep until the next input.
+                current = phase::dimmed;
+                arm({});
+                continue;
+            }
+
+            logging::debug("Idle; dimming.");
+            ++s.dims;
+            current = phase::fading;
+            fade_start = t;
+            arm(t, period);
+        } else if (current == phase::fading) {
+            double f = c.fade.count() > 0
+                           ? std::chrono::duration<double>(t - fade_start) /
+                                 c.fade
+                           : 1.0;
+            for (std::size_t i = 0; i < states.size(); ++i)
+                step(states[i], dimmers[i], c, f);
+            if (f >= 1.0) {
+                current = phase::dimmed;
+                arm({});
+            }
+        }
+    }
+
+    if (current != phase::active)
+        restore_all(s);
+    return s;
+}
@@ -0,0 +1,125 @@
+#ifndef IDLE_HPP
+#define IDLE_HPP
+
+#include "app.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/input.h>
+#include <string>
+#include <vector>
+
+#ifndef INPUT_PREFIX
+#define INPUT_PREFIX "/dev/input/"
+#endif
+
+namespace idle
+{
+
+// When to dim and how far.
+struct config {
+    // Time without input before dimming.
+    std::chrono::milliseconds timeout{60000};
+
+    // Level to dim to; keyboards already at or below it are left alone.
+    uint32_t level = 0;
+
+    // How long dimming takes. Restoring is always immediate.
+    std::chrono::milliseconds fade{1000};
+};
+
+struct stats {
+    uint64_t events = 0;   // Input events counted as activity.
+    uint64_t dims = 0;     // Times the keyboards were dimmed.
+    uint64_t restores = 0; // Times they were brought back.
+};
+
+/**
+ * @brief Whether the evdev device open on fd is a keyboard or a pointer.
+ *
+ * Keyboards report KEY_SPACE; mice, touchpads and trackpoints report
+ * relative axes, BTN_LEFT or BTN_TOUCH. Power buttons, lid switches and
+ * the like are none of these.
+ **/
+bool interactive(int fd);
+
+// Paths of the keyboards and pointers among the event* devices in path
+// that this process can read.
+std::vector<std::string> discover(const std::string &path = INPUT_PREFIX);
+
+/**
+ * @brief Dims keyboards when no input arrives for a while.
+ *
+ * Every input source and a single CLOCK_MONOTONIC timerfd share one
+ * epoll set, so an idle monitor sleeps until either input arrives or
+ * the deadline passes, and reacts to the first event after dimming at
+ * once. The deadline isn't re-armed for every event: input only
+ * records when it arrived, and when the timer fires early because of
+ * it, the timer is pushed back to that time plus the timeout. Busy
+ * typing therefore costs one read per batch of events and one
+ * timerfd_settime() per timeout at most.
+ *
+ * Sources deliver struct input_event records; anything that does, like
+ * a pipe of synthetic events, works as well as an evdev device.
+ **/
+class monitor
+{
+private:
+    struct source {
+        int fd = -1;
+        bool owned = false;
+
+        // The start of a record split across reads, from a pipe.
+        std::size_t partial = 0;
+        char buffer[sizeof(input_event)] = {};
+    };
+
+    int m_epoll = -1;
+    int m_timer = -1;
+    std::vector<source> m_sources;
+    std::size_t m_open = 0;
+
+public:
+    // @throws std::system_error if epoll or the timerfd is unavailable.
+    monitor(void);
+    ~monitor(void);
+
+    monitor(const monitor &) = delete;
+    monitor &operator=(const monitor &) = delete;
+
+    // @throws std::system_error if path can't be opened.
+    void open(const std::string &path);
+
+    // Watch fd, closing it when done only if owned.
+    void add(int fd, bool owned);
+
+    // Sources that haven't reached end of file.
+    std::size_t size(void) const;
+
+    /**
+     * @brief Dim states after c.timeout without input, until SIGINT,
+     *        SIGTERM or every source has closed.
+     *
+     * Dimming fades brightness along the lightness curve after storing
+     * the level it started from in the brightness cache. The next
+     * input restores the cached level straight away, unless something
+     * else changed the brightness in the meantime. Keyboards still
+     * dimmed when this returns are restored too.
+     **/
+    stats run(std::deque<app::state> &states, const config &c);
+
+private:
+    // Consume what source i has to read; whether any of it was input.
+    bool drain(std::size_t i, stats &s);
+    void remove(std::size_t i);
+
+    // Fire once at the CLOCK_MONOTONIC time at, or every period from
+    // now on; zero disarms.
+    void arm(std::chrono::nanoseconds at,
+             std::chrono::nanoseconds period = {});
+};
+
+}; // namespace idle
+
+#endif /* IDLE_HPP */
@@ -0,0 +1,346 @@
+#include "ipc.hpp"
+#include "logging.hpp"
+#include "signals.hpp"
+#include "watcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// How long the daemon may sit on unsaved state.
+static constexpr std::chrono::seconds flush_interval(1);
+
+// How long a connection may sit without sending or reading anything.
+static constexpr std::chrono::seconds client_timeout(30);
+
+// Connections served at once; more are turned away.
+static constexpr std::size_t max_clients = 64;
+
+static bool make_address(const std::string &path, sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Read or write exactly n bytes; returns false on EOF or error.
+static bool read_all(int fd, void *buf, std::size_t n)
+{
+    auto *p = static_cast<char *>(buf);
+    while (n) {
+        ssize_t rc = ::read(fd, p, n);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        p += rc;
+        n -= rc;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *buf, std::size_t n)
+{
+    auto *p = static_cast<const char *>(buf);
+    while (n) {
+        ssize_t rc = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        p += rc;
+        n -= rc;
+    }
+    return true;
+}
+
+// One connection to the daemon, served from the poll loop: it never
+// blocks the daemon, however slowly it sends or reads.
+struct client {
+    int fd = -1;
+    app::request req;
+    std::size_t received = 0;
+    app::response res;
+    std::size_t sent = 0;
+    bool replying = false;
+    clock_type::time_point active;
+};
+
+// Send what's left of c's response; false if the connection broke.
+static bool send_reply(client &c)
+{
+    auto *p = reinterpret_cast<const char *>(&c.res);
+    while (c.sent < sizeof(c.res)) {
+        ssize_t rc = ::send(c.fd, p + c.sent, sizeof(c.res) - c.sent,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (rc <= 0)
+            return false;
+        c.sent += rc;
+    }
+    c.replying = false;
+    return true;
+}
+
+// Read from c and answer at most one complete request, so every client
+// gets its turn; false once the connection is done.
+static bool serve_client(client &c, app::state &st, bool tracking)
+{
+    if (c.replying)
+        return send_reply(c);
+
+    auto *p = reinterpret_cast<char *>(&c.req);
+    while (c.received < sizeof(c.req)) {
+        ssize_t rc = ::read(c.fd, p + c.received,
+                            sizeof(c.req) - c.received);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (rc <= 0)
+            return false;
+        c.received += rc;
+    }
+    c.received = 0;
+
+    // Without a watcher, the firmware may have changed brightness
+    // since our last request.
+    if (!tracking)
+        st.brightness.reload();
+
+    try {
+        c.res = app::run(st, c.req);
+    } catch (std::exception &e) {
+        c.res = app::response();
+        c.res.status = 1;
+        strncpy(c.res.error, e.what(), sizeof(c.res.error) - 1);
+    }
+    c.sent = 0;
+    c.replying = true;
+    return send_reply(c);
+}
+
+static void accept_clients(int sock, std::vector<client> &clients)
+{
+    for (;;) {
+        int fd = accept4(sock, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                logging::error("accept() failed:", strerror(errno));
+            return;
+        }
+        if (clients.size() >= max_clients) {
+            close(fd);
+            continue;
+        }
+
+        client c;
+        c.fd = fd;
+        c.active = clock_type::now();
+        clients.push_back(c);
+    }
+}
+
+static void flush(app::state &st)
+{
+    try {
+        st.cache.file.flush();
+    } catch (std::system_error &e) {
+        logging::error("Unable to save state:", e.what());
+    }
+}
+
+int ipc::serve(const std::string &path, fs::batch::backend backend)
+{
+    sockaddr_un addr;
+    if (!make_address(path, addr)) {
+        logging::error("Socket path too long:", path);
+        return 1;
+    }
+
+    if (!app::ensure_cache_dir()) {
+        logging::error("mkdir() failed on:", CACHE_PREFIX);
+        return 1;
+    }
+
+    // Refuse to steal the socket from a daemon that is still alive.
+    app::request probe;
+    app::response ignored;
+    probe.version = 0;
+    try {
+        if (ipc::send(path, probe, ignored)) {
+            logging::error("A daemon is already listening on", path);
+            return 1;
+        }
+    } catch (std::system_error &) {
+        // Something answered but broke the exchange; treat it as stale.
+    }
+    unlink(path.c_str());
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        logging::error("socket() failed:", strerror(errno));
+        return 1;
+    }
+
+    auto *sa_addr = reinterpret_cast<sockaddr *>(&addr);
+    if (bind(sock, sa_addr, sizeof(addr)) == -1 || listen(sock, 16) == -1) {
+        logging::error("Unable to listen on", path + ":", strerror(errno));
+        close(sock);
+        return 1;
+    }
+
+    // Any local user may drive the keyboard LEDs, just like the hotkeys.
+    chmod(path.c_str(), 0666);
+
+    signals::install();
+
+    app::state st(led::default_device());
+    st.batch.select(backend);
+    st.fader.emplace();
+
+    // Follow Fn key changes as they happen rather than re-reading
+    // brightness on every request.
+    std::optional<led::hw_watcher> watcher;
+    try {
+        watcher.emplace();
+    } catch (std::system_error &e) {
+        logging::warn("Not tracking hardware brightness:", e.what());
+    }
+
+    // The listening socket, brightness_hw_changed and the fader come
+    // first, then one entry per client.
+    std::vector<client> clients;
+    std::vector<pollfd> fds;
+
+    // Coalesce state file writes: flush at most once per interval, and
+    // only sleep with a timeout while there is something to flush.
+    std::optional<clock_type::time_point> flush_at;
+
+    logging::info("Listening on", path);
+    while (signals::running()) {
+        fds.assign({{sock, POLLIN, 0},
+                    {watcher ? watcher->fd() : -1, POLLPRI | POLLERR, 0},
+                    {st.fader->fd(), POLLIN, 0}});
+        for (auto &c : clients)
+            fds.push_back({c.fd, short(c.replying ? POLLOUT : POLLIN), 0});
+
+        // Wake up for the next flush, and now and then to drop stalled
+        // clients while there are any.
+        int timeout = clients.empty() ? -1 : 1000;
+        if (flush_at) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                *flush_at - clock_type::now());
+            int limit = timeout == -1 ? std::numeric_limits<int>::max()
+                                      : timeout;
+            timeout = std::clamp<int>(left.count(), 0, limit);
+        }
+
+        int rc = poll(fds.data(), fds.size(), timeout);
+        auto now = clock_type::now();
+        if (flush_at && now >= *flush_at) {
+            flush(st);
+            flush_at.reset();
+        }
+
+        if (rc == -1 && errno != EINTR)
+            logging::error("poll() failed:", strerror(errno));
+
+        if (rc > 0 && fds[1].revents) {
+            if (auto level = watcher->consume())
+                app::on_hw_changed(st, *level);
+        }
+
+        // Fades step between requests rather than blocking them.
+        if (rc > 0 && (fds[2].revents & POLLIN)) {
+            try {
+                st.fader->step(st.brightness);
+            } catch (std::system_error &e) {
+                logging::error("Fade step failed:", e.what());
+                st.fader->cancel();
+                st.brightness.reload();
+            }
+        }
+
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            auto &c = clients[i];
+            bool open = true;
+            if (rc > 0 && fds[i + 3].revents) {
+                c.active = now;
+                open = serve_client(c, st, watcher.has_value());
+            }
+            if (!open || now - c.active > client_timeout) {
+                close(c.fd);
+                c.fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [](const client &c) {
+                                         return c.fd == -1;
+                                     }),
+                      clients.end());
+
+        if (rc > 0 && (fds[0].revents & POLLIN))
+            accept_clients(sock, clients);
+
+        if (st.cache.file.dirty() && !flush_at)
+            flush_at = clock_type::now() + flush_interval;
+    }
+
+    for (auto &c : clients)
+        close(c.fd);
+    close(sock);
+    unlink(path.c_str());
+    return 0;
+}
+
+bool ipc::send(const std::string &path, const app::request &req,
+               app::response &res)
+{
+    sockaddr_un addr;
+    if (!make_address(path, addr))
+        return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return false;
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+        -1) {
+        close(fd);
+        return false;
+    }
+
+    errno = 0;
+    bool ok = write_all(fd, &req, sizeof(req)) &&
+              read_all(fd, &res, sizeof(res));
+    int error = errno;
+    close(fd);
+
+    if (!ok) {
+        throw std::system_error(error ? error : EPIPE,
+                                std::generic_category(),
+                                "daemon exchange failed");
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef IPC_HPP
+#define IPC_HPP
+
+#include "app.hpp"
+#include <string>
+
+#ifndef SOCKET_PATH
+#define SOCKET_PATH "/run/system76-kbd-led.sock"
+#endif
+
+namespace ipc
+{
+
+/**
+ * @brief Run the daemon until SIGINT or SIGTERM is received.
+ *
+ * Binds a Unix stream socket at path and serves app::request structs
+ * on it; each request is answered with exactly one app::response. A
+ * connection may carry any number of requests. Connections are
+ * non-blocking and served together from one poll loop, a request at a
+ * time each, so a client that stalls or floods the socket can't hold
+ * up the others; idle ones are dropped after 30 seconds. The
+ * keyboard, brightness and cache state is constructed once and kept
+ * for the daemon's lifetime.
+ *
+ * @param path Path to bind the socket at.
+ * @param backend How the attribute writes of a request are submitted.
+ * @returns Process exit code.
+ **/
+int serve(const std::string &path,
+          fs::batch::backend backend = fs::batch::backend::pwrite);
+
+/**
+ * @brief Forward req to a running daemon and wait for its response.
+ *
+ * @param path Path of the daemon's socket.
+ * @param req Request to forward.
+ * @param res Response filled in on success.
+ * @returns false if no daemon is listening at path, in which case the
+ *          caller should fall back to applying req itself.
+ * @throws std::system_error if a daemon was reached but the exchange
+ *         failed; req may or may not have been applied.
+ **/
+bool send(const std::string &path, const app::request &req,
+          app::response &res);
+
+}; // namespace ipc
+
+#endif /* IPC_HPP */
@@ -1,56 +1,214 @@
 #include "keyboard.hpp"
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
 using namespace color;
 
-std::array<rgb, 4> keyboard::regions(void) const
+keyboard::keyboard(void)
+    : keyboard(SYSFS_PREFIX)
 {
-    return {left_region().color(), center_region().color(),
-            right_region().color(), extra_region().color()};
 }
 
-region<left, rgb> &keyboard::left_region(void)
+keyboard::keyboard(const std::string &dir, const color::layout &l)
+    : m_layout(l)
+    , m_colors(l.size())
+    , m_staged(l.size())
+    , m_flags(l.size())
 {
-    return m_left;
+    m_nodes.reserve(l.size());
+    for (auto &z : l.zones())
+        m_nodes.emplace_back(z.path(dir));
 }
 
-const region<color::left, rgb> &keyboard::left_region(void) const
+const color::layout &keyboard::layout(void) const
 {
-    return m_left;
+    return m_layout;
 }
 
-region<center, rgb> &keyboard::center_region(void)
+std::size_t keyboard::size(void) const
 {
-    return m_center;
+    return m_nodes.size();
 }
 
-const region<color::center, rgb> &keyboard::center_region(void) const
+rgb keyboard::color(std::size_t i) const
 {
-    return m_center;
+    if (!(m_flags[i] & is_known))
+        read_color(i);
+    return m_colors.get(i);
 }
 
-region<right, rgb> &keyboard::right_region(void)
+const buffer &keyboard::colors(void) const
 {
-    return m_right;
+    for (std::size_t i = 0; i < size(); ++i) {
+        if (!(m_flags[i] & is_known))
+            read_color(i);
+    }
+    return m_colors;
 }
 
-const region<color::right, rgb> &keyboard::right_region(void) const
+std::array<rgb, 4> keyboard::regions(void) const
 {
-    return m_right;
+    std::array<rgb, 4> out;
+    for (std::size_t i = 0; i < out.size(); ++i)
+        out[i] = color(std::min(i, size() - 1));
+    return out;
 }
 
-region<extra, rgb> &keyboard::extra_region(void)
+std::array<rgb, 4> keyboard::pending(void) const
 {
-    return m_extra;
+    std::array<rgb, 4> out;
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        auto z = std::min(i, size() - 1);
+        out[i] = (m_flags[z] & is_staged) ? m_staged.get(z) : color(z);
+    }
+    return out;
 }
 
-const region<color::extra, rgb> &keyboard::extra_region(void) const
+std::array<std::optional<rgb>, 4> keyboard::known(void) const
 {
-    return m_extra;
+    std::array<std::optional<rgb>, 4> out;
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        auto z = std::min(i, size() - 1);
+        if (m_flags[z] & is_known)
+            out[i] = m_colors.get(z);
+    }
+    return out;
 }
 
 void keyboard::set_color(const color::rgb &color)
 {
-    m_left.set_color(color);
-    m_center.set_color(color);
-    m_right.set_color(color);
-    m_extra.set_color(color);
+    stage(color);
+    commit();
+}
+
+void keyboard::stage(const color::rgb &color)
+{
+    m_staged.fill(color);
+    for (auto &f : m_flags)
+        f |= is_staged;
+}
+
+void keyboard::stage(std::size_t i, const color::rgb &color)
+{
+    m_staged.set(i, color);
+    m_flags[i] |= is_staged;
+}
+
+void keyboard::stage(const std::array<rgb, 4> &colors)
+{
+    for (std::size_t i = 0; i < std::min(colors.size(), size()); ++i)
+        stage(i, colors[i]);
+}
+
+void keyboard::stage(const buffer &colors)
+{
+    if (colors.size() != size())
+        throw std::invalid_argument("Color count doesn't match layout.");
+    m_staged = colors;
+    for (auto &f : m_flags)
+        f |= is_staged;
+}
+
+fs::commit_stats keyboard::commit(void)
+{
+    fs::batch batch;
+    auto stats = commit(batch);
+    batch.submit();
+    return stats;
+}
+
+fs::commit_stats keyboard::commit(fs::batch &batch)
+{
+    fs::commit_stats stats;
+    for (std::size_t i = 0; i < size(); ++i) {
+        if (!(m_flags[i] & is_staged))
+            continue;
+
+        if (m_staged.get(i) != color(i)) {
+            write_color(i, batch);
+            ++stats.written;
+        } else {
+            ++stats.skipped;
+        }
+        m_flags[i] &= ~is_staged;
+    }
+    return stats;
+}
+
+fs::commit_stats keyboard::force_commit(void)
+{
+    fs::batch batch;
+    auto stats = force_commit(batch);
+    batch.submit();
+    return stats;
+}
+
+fs::commit_stats keyboard::force_commit(fs::batch &batch)
+{
+    fs::commit_stats stats;
+    for (std::size_t i = 0; i < size(); ++i) {
+        if (!(m_flags[i] & is_staged))
+            continue;
+
+        write_color(i, batch);
+        ++stats.written;
+        m_flags[i] &= ~is_staged;
+    }
+    return stats;
+}
+
+void keyboard::forget(void)
+{
+    for (auto &f : m_flags)
+        f &= ~is_known;
+}
+
+void keyboard::read_color(std::size_t i) const
+{
+    char buf[32];
+    auto n = m_nodes[i].read(buf, sizeof(buf));
+
+    if (m_layout.zones()[i].encoding == encoding::hex) {
+        if (n < hex::width) {
+            throw std::runtime_error("Short read of " + m_nodes[i].path() +
+                                     ".");
+        }
+        m_colors.set(i, rgb(std::string_view(buf, hex::width)));
+    } else {
+        // Three decimal channels separated by single spaces.
+        uint32_t value = 0;
+        const char *p = buf, *end = buf + n;
+        for (int c = 0; c < 3; ++c) {
+            unsigned channel;
+            auto [ptr, ec] = std::from_chars(p, end, channel);
+            if (ec != std::errc() || channel > 255 ||
+                (c < 2 && (ptr == end || *ptr != ' '))) {
+                throw std::runtime_error("Malformed color in " +
+                                         m_nodes[i].path() + ".");
+            }
+            value = (value << 8) | channel;
+            p = ptr + 1;
+        }
+        m_colors.set(i, rgb(value));
+    }
+    m_flags[i] |= is_known;
+}
+
+// Queue the write of zone i's staged color; m_colors assumes it
+// succeeds.
+void keyboard::write_color(std::size_t i, fs::batch &batch)
+{
+    auto c = m_staged.get(i);
+    m_colors.set(i, c);
+    m_flags[i] |= is_known;
+
+    // Encoded straight onto the stack.
+    char buf[16];
+    int n;
+    if (m_layout.zones()[i].encoding == encoding::hex)
+        n = to_chars(buf, buf + sizeof(buf), c).ptr - buf;
+    else
+        n = snprintf(buf, sizeof(buf), "%u %u %u", c.red(), c.green(),
+                     c.blue());
+    batch.write(m_nodes[i], buf, n);
 }
@@ -1,35 +1,118 @@
 #ifndef KEYBOARD_HPP
 #define KEYBOARD_HPP
 
+#include "batch.hpp"
 #include "color.hpp"
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace color
 {
 
+/**
+ * @brief The zones of a keyboard, as described by its layout.
+ *
+ * Colors are read from sysfs lazily, the first time each zone's color
+ * is needed, and written through the stage/commit path so unchanged
+ * zones are never written. Known and staged colors are kept in
+ * color::buffers.
+ *
+ * The fixed size array overloads cover the first four zones, which is
+ * what requests, caches and profiles carry; on layouts with fewer
+ * zones the last one stands in for the missing ones.
+ **/
 class keyboard
 {
 private:
-    region<color::left, rgb> m_left;
-    region<color::center, rgb> m_center;
-    region<color::right, rgb> m_right;
-    region<color::extra, rgb> m_extra;
+    // Compiled-in, or loaded by the caller for our whole lifetime.
+    const color::layout &m_layout;
+    mutable std::vector<fs::node> m_nodes;
+
+    // Last colors known to be in hardware.
+    mutable buffer m_colors;
+
+    // Colors waiting for the next commit().
+    buffer m_staged;
+
+    // Per zone: whether m_colors and m_staged hold a color for it.
+    enum : uint8_t { is_known = 1, is_staged = 2 };
+    mutable std::vector<uint8_t> m_flags;
 
 public:
-    std::array<rgb, 4> regions(void) const;
+    // The four-zone keyboard at SYSFS_PREFIX.
+    keyboard(void);
+
+    // The keyboard whose attributes live in dir.
+    explicit keyboard(const std::string &dir,
+                      const color::layout &l = four_zone());
 
-    region<left, rgb> &left_region(void);
-    const region<color::left, rgb> &left_region(void) const;
+    const color::layout &layout(void) const;
 
-    region<center, rgb> &center_region(void);
-    const region<color::center, rgb> &center_region(void) const;
+    // Number of zones.
+    std::size_t size(void) const;
 
-    region<right, rgb> &right_region(void);
-    const region<color::right, rgb> &right_region(void) const;
+    // Color of zone i, read from sysfs if it isn't known yet.
+    rgb color(std::size_t i) const;
 
-    region<extra, rgb> &extra_region(void);
-    const region<color::extra, rgb> &extra_region(void) const;
+    // Every zone's color.
+    const buffer &colors(void) const;
+
+    std::array<rgb, 4> regions(void) const;
+
+    // Colors the regions will have after the next commit().
+    std::array<rgb, 4> pending(void) const;
+
+    // Colors known without reading sysfs; unread regions are empty.
+    std::array<std::optional<rgb>, 4> known(void) const;
 
     void set_color(const color::rgb &color);
+
+    /**
+     * @brief Stage color on every zone.
+     **/
+    void stage(const color::rgb &color);
+
+    /**
+     * @brief Stage color on zone i.
+     **/
+    void stage(std::size_t i, const color::rgb &color);
+
+    /**
+     * @brief Stage colors[i] on zone i, for the first four zones.
+     **/
+    void stage(const std::array<rgb, 4> &colors);
+
+    /**
+     * @brief Stage colors on every zone; sizes must match.
+     **/
+    void stage(const buffer &colors);
+
+    /**
+     * @brief Write every staged zone whose color actually changed.
+     **/
+    fs::commit_stats commit(void);
+
+    /**
+     * @brief Like commit(), with the writes queued on batch.
+     **/
+    fs::commit_stats commit(fs::batch &batch);
+
+    /**
+     * @brief Write every staged zone without reading hardware first.
+     **/
+    fs::commit_stats force_commit(void);
+    fs::commit_stats force_commit(fs::batch &batch);
+
+    /**
+     * @brief Forget every known color, e.g. after a failed batch.
+     **/
+    void forget(void);
+
+private:
+    void read_color(std::size_t i) const;
+    void write_color(std::size_t i, fs::batch &batch);
 };
 
 }; // namespace color
@@ -1,6 +1,57 @@
 #include "logging.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
 
-bool logging::state::debug = true;
+using namespace logging;
+
+bool logging::state::debug = false;
+
+record::record(int fd, std::string_view prefix)
+    : m_fd(fd)
+{
+    append(prefix);
+}
+
+void record::append(std::string_view s)
+{
+    if (m_space) {
+        m_space = false;
+        append(' ');
+    }
+
+    // Keep room for the newline.
+    std::size_t n = std::min(s.size(), capacity - 1 - m_size);
+    memcpy(m_buf + m_size, s.data(), n);
+    m_size += n;
+}
+
+void record::append(char c)
+{
+    append(std::string_view(&c, 1));
+}
+
+void record::space(void)
+{
+    m_space = true;
+}
+
+void record::write(void)
+{
+    m_buf[m_size++] = '\n';
+    const char *p = m_buf;
+    std::size_t left = m_size;
+    while (left) {
+        ssize_t rc = ::write(m_fd, p, left);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return;
+        p += rc;
+        left -= rc;
+    }
+}
 
 void logging::set_debug(bool enabled)
 {
@@ -1,69 +1,134 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
 
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
 #include <type_traits>
 
+// Least severe level compiled in: 0 debug, 1 info, 2 warn, 3 error.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 0
+#endif
+
 namespace logging
 {
 
+enum class level { debug, info, warn, error };
+
+// Calls below this level compile to nothing, arguments included.
+inline constexpr level min_level = static_cast<level>(LOG_LEVEL);
+
 struct state {
+    // Debug records are only written with -v.
     static bool debug;
 };
 
-template <typename T>
-void _log_to(std::stringstream &ss, T &&arg)
+/**
+ * @brief One log line, formatted into a fixed buffer.
+ *
+ * Nothing is allocated and nothing goes through iostreams: the line is
+ * built in place and handed to the kernel with a single write(2) when
+ * it is complete, which also keeps lines from concurrent threads from
+ * interleaving. Lines longer than the buffer are truncated.
+ **/
+class record
 {
-    ss << arg << std::endl;
-}
+private:
+    static constexpr std::size_t capacity = 512;
 
-template <typename T, typename... Args>
-void _log_to(std::stringstream &ss, T &&arg, Args &&... args)
-{
-    ss << arg;
+    char m_buf[capacity];
+    std::size_t m_size = 0;
+    int m_fd;
+
+    // A separator owed before whatever is appended next.
+    bool m_space = false;
+
+public:
+    record(int fd, std::string_view prefix);
 
-    // If our given T is not an openmode or fmtflag, add a space
-    // to the stringstream after it.
-    if constexpr (std::is_same_v<std::decay_t<T>, std::string> ||
-                  std::is_same_v<std::decay_t<T>, const char *>)
-        ss << " ";
+    void append(std::string_view s);
+    void append(char c);
+
+    // Separate whatever comes next with a space.
+    void space(void);
+
+    template <typename T>
+    void append_number(T value)
+    {
+        char buf[32];
+        std::to_chars_result r;
+        if constexpr (std::is_floating_point_v<T>)
+            r = std::to_chars(buf, buf + sizeof(buf), value,
+                              std::chars_format::general, 6);
+        else
+            r = std::to_chars(buf, buf + sizeof(buf), value);
+        append(std::string_view(buf, r.ptr - buf));
+    }
+
+    // Terminate the line and write it out.
+    void write(void);
+};
+
+template <typename T>
+void append(record &r, T &&arg)
+{
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, char>)
+        r.append(arg);
+    else if constexpr (std::is_same_v<U, bool>)
+        r.append(arg ? '1' : '0');
+    else if constexpr (std::is_arithmetic_v<U>)
+        r.append_number(arg);
+    else if constexpr (std::is_convertible_v<T, std::string_view>)
+        r.append(std::string_view(arg));
+    else
+        static_assert(std::is_void_v<T>, "unsupported log argument");
 
-    _log_to(ss, std::forward<Args>(args)...);
+    // Strings are separated from what follows by a space; anything else
+    // runs into it.
+    if constexpr (std::is_same_v<U, std::string> ||
+                  std::is_same_v<U, const char *>)
+        r.space();
 }
 
 template <typename... Args>
-void log_to(std::ostream &os, Args &&... args)
+void log_to(int fd, std::string_view prefix, Args &&... args)
 {
-    std::stringstream ss;
-    _log_to(ss, std::forward<Args>(args)...);
-    os << ss.str();
+    record r(fd, prefix);
+    (append(r, std::forward<Args>(args)), ...);
+    r.write();
 }
 
 template <typename... Args>
 void info(Args &&... args)
 {
-    log_to(std::cout, "[INFO]", std::forward<Args>(args)...);
+    if constexpr (min_level <= level::info)
+        log_to(1, "[INFO] ", std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 void debug(Args &&... args)
 {
-    if (state::debug)
-        log_to(std::cout, "[ DBG]", std::forward<Args>(args)...);
+    if constexpr (min_level <= level::debug) {
+        if (state::debug)
+            log_to(1, "[ DBG] ", std::forward<Args>(args)...);
+    }
 }
 
 template <typename... Args>
 void error(Args &&... args)
 {
-    log_to(std::cerr, "[ ERR]", std::forward<Args>(args)...);
+    if constexpr (min_level <= level::error)
+        log_to(2, "[ ERR] ", std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 void warn(Args &&... args)
 {
-    log_to(std::cout, "[WARN]", std::forward<Args>(args)...);
+    if constexpr (min_level <= level::warn)
+        log_to(1, "[WARN] ", std::forward<Args>(args)...);
 }
 
 void set_debug(bool enabled);
@@ -0,0 +1,278 @@
+#include "metrics.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <pthread.h>
+#include <sstream>
+#include <system_error>
+#include <unistd.h>
+
+using namespace metrics;
+
+static constexpr std::size_t capacity = 64;
+static file table[capacity];
+
+// Entries below this index are registered; it's only ever raised, and
+// only after the entry's path is in place.
+static std::atomic<std::size_t> used{0};
+static std::mutex table_mutex;
+
+static const uint64_t started = now();
+
+static const char *const op_names[op_count] = {"open", "read", "write"};
+
+static constexpr auto relaxed = std::memory_order_relaxed;
+
+void histogram::record(uint64_t ns, bool ok)
+{
+    count.fetch_add(1, relaxed);
+    if (!ok)
+        errors.fetch_add(1, relaxed);
+    sum_ns.fetch_add(ns, relaxed);
+
+    uint64_t max = max_ns.load(relaxed);
+    while (ns > max && !max_ns.compare_exchange_weak(max, ns, relaxed))
+        ;
+
+    std::size_t i = 0;
+    while (i < bounds.size() && ns > uint64_t(bounds[i]) * 1000)
+        ++i;
+    buckets[i].fetch_add(1, relaxed);
+}
+
+file *metrics::lookup(std::string_view path)
+{
+    path = path.substr(0, sizeof(file::path) - 1);
+
+    std::lock_guard<std::mutex> guard(table_mutex);
+    std::size_t n = used.load(relaxed);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (path == table[i].path)
+            return &table[i];
+    }
+    if (n == capacity)
+        return nullptr;
+
+    memcpy(table[n].path, path.data(), path.size());
+    used.store(n + 1, std::memory_order_release);
+    return &table[n];
+}
+
+static std::size_t registered(void)
+{
+    return used.load(std::memory_order_acquire);
+}
+
+// Upper bound in microseconds of the bucket holding quantile q of h,
+// capped at the slowest sample.
+static double quantile(const histogram &h, double q)
+{
+    uint64_t count = h.count.load(relaxed);
+    uint64_t rank = std::max<uint64_t>(1, q * count + 0.5);
+    double max = h.max_ns.load(relaxed) / 1000.0;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < bounds.size(); ++i) {
+        seen += h.buckets[i].load(relaxed);
+        if (seen >= rank)
+            return std::min<double>(bounds[i], max);
+    }
+    return max;
+}
+
+// Quote s for JSON or a Prometheus label value.
+static void quoted(std::ostream &os, const char *s)
+{
+    os << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            os << '\\';
+        os << *s;
+    }
+    os << '"';
+}
+
+void metrics::print(std::ostream &os)
+{
+    auto flags = os.flags();
+    os << std::fixed << std::setprecision(1);
+    os << "I/O over " << (now() - started) / 1e6 << " ms:\n"
+       << std::setw(8) << "op" << std::setw(8) << "count" << std::setw(8)
+       << "errors" << std::setw(10) << "mean us" << std::setw(10)
+       << "p50 us" << std::setw(10) << "p99 us" << std::setw(10)
+       << "max us"
+       << "  path\n";
+
+    for (std::size_t i = 0; i < registered(); ++i) {
+        for (std::size_t o = 0; o < op_count; ++o) {
+            auto &h = table[i].ops[o];
+            uint64_t count = h.count.load(relaxed);
+            if (!count)
+                continue;
+            os << std::setw(8) << op_names[o] << std::setw(8) << count
+               << std::setw(8) << h.errors.load(relaxed) << std::setw(10)
+               << h.sum_ns.load(relaxed) / 1e3 / count << std::setw(10)
+               << quantile(h, 0.5) << std::setw(10) << quantile(h, 0.99)
+               << std::setw(10) << h.max_ns.load(relaxed) / 1e3 << "  "
+               << table[i].path << '\n';
+        }
+    }
+    os.flags(flags);
+}
+
+void metrics::print_json(std::ostream &os)
+{
+    os << "{\"elapsed_us\":" << (now() - started) / 1000 << ",\"bounds_us\":[";
+    for (std::size_t i = 0; i < bounds.size(); ++i)
+        os << (i ? "," : "") << bounds[i];
+    os << "],\"files\":[";
+
+    for (std::size_t i = 0; i < registered(); ++i) {
+        os << (i ? ",{\"path\":" : "{\"path\":");
+        quoted(os, table[i].path);
+        for (std::size_t o = 0; o < op_count; ++o) {
+            auto &h = table[i].ops[o];
+            os << ",\"" << op_names[o]
+               << "\":{\"count\":" << h.count.load(relaxed)
+               << ",\"errors\":" << h.errors.load(relaxed)
+               << ",\"sum_ns\":" << h.sum_ns.load(relaxed)
+               << ",\"max_ns\":" << h.max_ns.load(relaxed)
+               << ",\"buckets\":[";
+            for (std::size_t b = 0; b < h.buckets.size(); ++b)
+                os << (b ? "," : "") << h.buckets[b].load(relaxed);
+            os << "]}";
+        }
+        os << '}';
+    }
+    os << "]}\n";
+}
+
+void metrics::print_prometheus(std::ostream &os)
+{
+    const std::size_t n = registered();
+    auto labels = [&](std::size_t i, std::size_t o) {
+        os << "{path=";
+        quoted(os, table[i].path);
+        os << ",op=\"" << op_names[o] << '"';
+    };
+
+    os << "# HELP system76_kbd_led_io_seconds Latency of sysfs attribute "
+          "and cache file operations.\n"
+          "# TYPE system76_kbd_led_io_seconds histogram\n";
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t o = 0; o < op_count; ++o) {
+            auto &h = table[i].ops[o];
+            uint64_t seen = 0;
+            for (std::size_t b = 0; b < bounds.size(); ++b) {
+                seen += h.buckets[b].load(relaxed);
+                os << "system76_kbd_led_io_seconds_bucket";
+                labels(i, o);
+                os << ",le=\"" << bounds[b] / 1e6 << "\"} " << seen << '\n';
+            }
+            uint64_t count = h.count.load(relaxed);
+            os << "system76_kbd_led_io_seconds_bucket";
+            labels(i, o);
+            os << ",le=\"+Inf\"} " << count << '\n';
+            os << "system76_kbd_led_io_seconds_sum";
+            labels(i, o);
+            os << "} " << h.sum_ns.load(relaxed) / 1e9 << '\n';
+            os << "system76_kbd_led_io_seconds_count";
+            labels(i, o);
+            os << "} " << count << '\n';
+        }
+    }
+
+    os << "# HELP system76_kbd_led_io_errors_total Failed sysfs attribute "
+          "and cache file operations.\n"
+          "# TYPE system76_kbd_led_io_errors_total counter\n";
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t o = 0; o < op_count; ++o) {
+            os << "system76_kbd_led_io_errors_total";
+            labels(i, o);
+            os << "} " << table[i].ops[o].errors.load(relaxed) << '\n';
+        }
+    }
+
+    os << "# HELP system76_kbd_led_uptime_seconds Time since the process "
+          "started.\n"
+          "# TYPE system76_kbd_led_uptime_seconds gauge\n"
+          "system76_kbd_led_uptime_seconds "
+       << (now() - started) / 1e9 << '\n';
+}
+
+void metrics::write_prometheus(const std::string &path)
+{
+    std::ostringstream ss;
+    print_prometheus(ss);
+    auto text = ss.str();
+
+    // Scrapers read the file at any moment; never let them see half.
+    auto tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd == -1)
+        throw std::system_error(errno, std::generic_category(), tmp);
+
+    ssize_t rc = ::write(fd, text.data(), text.size());
+    int error = rc == -1 ? errno : EIO;
+    ::close(fd);
+
+    if (rc != static_cast<ssize_t>(text.size())) {
+        unlink(tmp.c_str());
+        throw std::system_error(error, std::generic_category(), tmp);
+    }
+    if (rename(tmp.c_str(), path.c_str()) == -1) {
+        error = errno;
+        unlink(tmp.c_str());
+        throw std::system_error(error, std::generic_category(), path);
+    }
+}
+
+exporter::exporter(std::string path, std::chrono::seconds interval)
+    : m_path(std::move(path))
+    , m_interval(interval)
+{
+    write();
+
+    // SIGINT and SIGTERM have to land on the thread doing the work, to
+    // interrupt whatever it's blocked in; the exporter's thread is
+    // started with them blocked.
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    m_thread = std::thread(&exporter::run, this);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+exporter::~exporter(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    write();
+}
+
+void exporter::run(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+        lock.unlock();
+        write();
+        lock.lock();
+    }
+}
+
+void exporter::write(void)
+{
+    try {
+        write_prometheus(m_path);
+    } catch (std::system_error &e) {
+        logging::error("Unable to write metrics:", e.what());
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <time.h>
+
+namespace metrics
+{
+
+// What was done to a file.
+enum class op : uint8_t {
+    open,  // Opening it, including any fallback and fstatfs(2).
+    read,  // One read.
+    write, // One write, or a whole replacement for a cache file.
+};
+
+inline constexpr std::size_t op_count = 3;
+
+// Upper bounds of the latency buckets in microseconds; one more bucket
+// past the last bound catches everything slower.
+inline constexpr std::array<uint32_t, 16> bounds = {
+    1,    2,    5,    10,    25,    50,    100,   250,
+    500,  1000, 2500, 5000, 10000, 25000, 50000, 100000,
+};
+
+inline uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Count, failures and a fixed-bucket latency histogram of one
+ * operation on one file.
+ *
+ * Every field is a relaxed atomic, so recording is a handful of
+ * uncontended increments and never takes a lock or allocates.
+ **/
+struct histogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, bounds.size() + 1> buckets{};
+
+    void record(uint64_t ns, bool ok);
+};
+
+/**
+ * @brief The histograms of one sysfs attribute or cache file.
+ **/
+struct file {
+    // Longer paths are truncated.
+    char path[128] = {};
+
+    std::array<histogram, op_count> ops;
+
+    histogram &at(op o)
+    {
+        return ops[static_cast<std::size_t>(o)];
+    }
+
+    const histogram &at(op o) const
+    {
+        return ops[static_cast<std::size_t>(o)];
+    }
+};
+
+/**
+ * @brief The entry for path, registering it on first use.
+ *
+ * The table is fixed-size and lives for the whole process; a program
+ * only ever touches a few dozen files. Once it's full, nullptr is
+ * returned and the file goes unrecorded.
+ **/
+file *lookup(std::string_view path);
+
+// Record one operation on f (if any) that started at started, from now().
+inline void record(file *f, op o, uint64_t started, bool ok)
+{
+    if (f)
+        f->at(o).record(now() - started, ok);
+}
+
+// Summaries of everything recorded so far.
+void print(std::ostream &os);
+void print_json(std::ostream &os);
+void print_prometheus(std::ostream &os);
+
+/**
+ * @brief Atomically replace path with the Prometheus text format.
+ *
+ * @throws std::system_error if the file can't be written.
+ **/
+void write_prometheus(const std::string &path);
+
+inline constexpr std::chrono::seconds export_interval(10);
+
+/**
+ * @brief Keep a Prometheus text file up to date, e.g. for
+ * node_exporter's textfile collector.
+ *
+ * The file is written when the exporter starts, every interval from a
+ * thread of its own while it runs, and once more when it's destroyed,
+ * so it ends up holding the final figures. Failed writes are logged.
+ **/
+class exporter
+{
+private:
+    std::string m_path;
+    std::chrono::seconds m_interval;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::thread m_thread;
+
+public:
+    explicit exporter(std::string path,
+                      std::chrono::seconds interval = export_interval);
+    ~exporter(void);
+
+    exporter(const exporter &) = delete;
+    exporter &operator=(const exporter &) = delete;
+
+private:
+    void run(void);
+    void write(void);
+};
+
+}; // namespace metrics
+
+#endif /* METRICS_HPP */
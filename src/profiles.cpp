@@ -0,0 +1,382 @@
+#include "profiles.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace fs;
+
+struct profile_store::header {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+
+    // Number of slots; always a power of two.
+    uint32_t capacity;
+
+    // Slots in use, and slots holding a deleted entry.
+    uint32_t count;
+    uint32_t tombstones;
+};
+
+struct profile_store::slot {
+    enum : uint8_t { empty = 0, used = 1, deleted = 2 };
+
+    uint32_t hash;
+    uint8_t state;
+    uint8_t length;
+    uint16_t reserved;
+    char name[max_name + 1];
+    uint32_t colors[4];
+    uint32_t brightness;
+    uint32_t reserved2;
+};
+
+static constexpr char magic[4] = {'S', '7', '6', 'P'};
+static constexpr uint16_t version = 1;
+static constexpr uint32_t initial_capacity = 64;
+
+static uint32_t name_hash(std::string_view name)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name)
+        h = (h ^ c) * 16777619u;
+    return h;
+}
+
+[[noreturn]] static void fail(int error, const std::string &path)
+{
+    throw std::system_error(error, std::generic_category(), path);
+}
+
+// Write buf to a temporary file of our own and rename it over path.
+// Returns the new file's descriptor, already locked.
+static int replace(const std::string &path, const std::vector<char> &buf)
+{
+    // Creating and growing may race across processes; a shared name
+    // would let one truncate the other's table.
+    std::string tmp = path + ".XXXXXX";
+    int fd = mkostemp(tmp.data(), O_CLOEXEC);
+    if (fd == -1)
+        fail(errno, tmp);
+    flock(fd, LOCK_EX);
+
+    ssize_t rc = -1;
+    if (fchmod(fd, 0644) == 0)
+        rc = ::write(fd, buf.data(), buf.size());
+    int error = rc == -1 ? errno : EIO;
+    if (rc == static_cast<ssize_t>(buf.size())) {
+        if (rename(tmp.c_str(), path.c_str()) == 0)
+            return fd;
+        error = errno;
+    }
+    ::close(fd);
+    unlink(tmp.c_str());
+    fail(error, tmp);
+}
+
+// Holds an exclusive flock(2) for the lifetime of a mutation. Refers to
+// the store's descriptor so it releases whichever file is current.
+class lock_guard
+{
+private:
+    int &m_fd;
+
+public:
+    explicit lock_guard(int &fd)
+        : m_fd(fd)
+    {
+        while (flock(m_fd, LOCK_EX) == -1 && errno == EINTR)
+            ;
+    }
+
+    ~lock_guard(void)
+    {
+        flock(m_fd, LOCK_UN);
+    }
+};
+
+profile_store::profile_store(std::string path, bool writable)
+    : m_path(std::move(path))
+    , m_writable(writable)
+{
+    open();
+}
+
+profile_store::~profile_store(void)
+{
+    unmap();
+    if (m_fd != -1)
+        ::close(m_fd);
+}
+
+std::optional<profile> profile_store::find(std::string_view name) const
+{
+    if (!m_map)
+        return std::nullopt;
+
+    auto *s = lookup(name, name_hash(name));
+    if (!s)
+        return std::nullopt;
+
+    profile p;
+    for (std::size_t i = 0; i < p.colors.size(); ++i)
+        p.colors[i] = color::rgb(s->colors[i]);
+    p.brightness = s->brightness;
+    return p;
+}
+
+void profile_store::save(std::string_view name, const profile &p)
+{
+    if (name.empty() || name.size() > max_name) {
+        throw std::invalid_argument("Profile names must be 1 to " +
+                                    std::to_string(max_name) +
+                                    " bytes long.");
+    }
+
+    lock_guard lock(m_fd);
+    map();
+
+    uint32_t h = name_hash(name);
+    slot *s = lookup(name, h);
+    if (!s) {
+        auto *t = table();
+        if ((t->count + t->tombstones + 1) * 10 > t->capacity * 7)
+            grow();
+
+        // Take the first free slot on the probe sequence.
+        t = table();
+        uint32_t mask = t->capacity - 1;
+        for (uint32_t i = h & mask;; i = (i + 1) & mask) {
+            s = &slots()[i];
+            if (s->state != slot::used)
+                break;
+        }
+
+        if (s->state == slot::deleted)
+            --t->tombstones;
+        ++t->count;
+
+        s->hash = h;
+        s->length = name.size();
+        memset(s->name, 0, sizeof(s->name));
+        memcpy(s->name, name.data(), name.size());
+    }
+
+    for (std::size_t i = 0; i < p.colors.size(); ++i)
+        s->colors[i] = p.colors[i].value();
+    s->brightness = p.brightness;
+
+    // Publish the slot last so a concurrent reader never sees a
+    // half-written entry as used.
+    __atomic_store_n(&s->state, slot::used, __ATOMIC_RELEASE);
+}
+
+bool profile_store::remove(std::string_view name)
+{
+    if (!m_map)
+        return false;
+
+    lock_guard lock(m_fd);
+    map();
+
+    auto *s = lookup(name, name_hash(name));
+    if (!s)
+        return false;
+
+    __atomic_store_n(&s->state, slot::deleted, __ATOMIC_RELEASE);
+    --table()->count;
+    ++table()->tombstones;
+    return true;
+}
+
+std::vector<std::string> profile_store::list(void) const
+{
+    std::vector<std::string> names;
+    if (!m_map)
+        return names;
+
+    // A corrupt length would read past the name; skip such slots.
+    for (uint32_t i = 0; i < table()->capacity; ++i) {
+        auto &s = slots()[i];
+        if (s.state == slot::used && s.length <= max_name)
+            names.emplace_back(s.name, s.length);
+    }
+    return names;
+}
+
+void profile_store::open(void)
+{
+    int flags = (m_writable ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC;
+    m_fd = ::open(m_path.c_str(), flags, 0644);
+    if (m_fd == -1) {
+        if (errno == ENOENT && !m_writable)
+            return;
+        fail(errno, m_path);
+    }
+
+    if (!m_writable) {
+        map();
+        return;
+    }
+
+    // The lock is held until the table is in place, so two first saves
+    // can't each create one.
+    lock_guard lock(m_fd);
+    follow();
+    struct stat st;
+    if (fstat(m_fd, &st) == -1)
+        fail(errno, m_path);
+    if (st.st_size == 0)
+        create(initial_capacity);
+    else
+        map();
+}
+
+void profile_store::follow(void)
+{
+    struct stat st, current;
+    for (;;) {
+        if (fstat(m_fd, &st) == -1)
+            fail(errno, m_path);
+        if (stat(m_path.c_str(), &current) == -1 ||
+            current.st_ino == st.st_ino)
+            return;
+
+        unmap();
+        int fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd == -1)
+            fail(errno, m_path);
+        flock(fd, LOCK_EX);
+        ::close(m_fd);
+        m_fd = fd;
+    }
+}
+
+void profile_store::map(void)
+{
+    if (m_writable)
+        follow();
+    struct stat st;
+    if (fstat(m_fd, &st) == -1)
+        fail(errno, m_path);
+
+    if (m_map && m_size == static_cast<std::size_t>(st.st_size))
+        return;
+    unmap();
+
+    if (static_cast<std::size_t>(st.st_size) < sizeof(header))
+        throw std::runtime_error(m_path + " is not a profile store.");
+
+    int prot = PROT_READ | (m_writable ? PROT_WRITE : 0);
+    void *p = mmap(nullptr, st.st_size, prot, MAP_SHARED, m_fd, 0);
+    if (p == MAP_FAILED)
+        fail(errno, m_path);
+    m_map = p;
+    m_size = st.st_size;
+
+    auto *t = table();
+    bool valid = !memcmp(t->magic, magic, sizeof(magic)) &&
+                 t->version == version && t->capacity &&
+                 !(t->capacity & (t->capacity - 1)) &&
+                 m_size == sizeof(header) + t->capacity * sizeof(slot);
+    if (!valid) {
+        unmap();
+        throw std::runtime_error(m_path + " is not a profile store.");
+    }
+}
+
+void profile_store::unmap(void)
+{
+    if (m_map)
+        munmap(m_map, m_size);
+    m_map = nullptr;
+    m_size = 0;
+}
+
+void profile_store::create(uint32_t capacity)
+{
+    std::vector<char> buf(sizeof(header) + capacity * sizeof(slot));
+    auto *t = reinterpret_cast<header *>(buf.data());
+    memcpy(t->magic, magic, sizeof(magic));
+    t->version = version;
+    t->capacity = capacity;
+    adopt(replace(m_path, buf));
+}
+
+void profile_store::grow(void)
+{
+    auto *old = table();
+    uint32_t capacity = old->capacity;
+    while ((old->count + 1) * 10 > capacity * 7 / 2)
+        capacity *= 2;
+
+    // Build the new table in anonymous memory, then write it out.
+    std::vector<char> buf(sizeof(header) + capacity * sizeof(slot));
+    auto *t = reinterpret_cast<header *>(buf.data());
+    auto *s = reinterpret_cast<slot *>(buf.data() + sizeof(header));
+    memcpy(t, old, sizeof(header));
+    t->capacity = capacity;
+    t->tombstones = 0;
+
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = 0; i < old->capacity; ++i) {
+        auto &e = slots()[i];
+        if (e.state != slot::used)
+            continue;
+        uint32_t j = e.hash & mask;
+        while (s[j].state == slot::used)
+            j = (j + 1) & mask;
+        s[j] = e;
+    }
+
+    adopt(replace(m_path, buf));
+}
+
+void profile_store::adopt(int fd)
+{
+    // Keep holding the lock, now on the new file.
+    unmap();
+    ::close(m_fd);
+    m_fd = fd;
+    map();
+}
+
+profile_store::header *profile_store::table(void) const
+{
+    return static_cast<header *>(m_map);
+}
+
+profile_store::slot *profile_store::slots(void) const
+{
+    return reinterpret_cast<slot *>(static_cast<char *>(m_map) +
+                                    sizeof(header));
+}
+
+profile_store::slot *profile_store::lookup(std::string_view name,
+                                           uint32_t hash) const
+{
+    // No slot can hold a longer name, and comparing one would read
+    // past the slot's name.
+    if (name.size() > max_name)
+        return nullptr;
+
+    uint32_t capacity = table()->capacity;
+    uint32_t i = hash & (capacity - 1);
+    for (uint32_t n = 0; n < capacity; ++n, i = (i + 1) & (capacity - 1)) {
+        auto *s = &slots()[i];
+        if (s->state == slot::empty)
+            return nullptr;
+        if (s->state == slot::used && s->hash == hash &&
+            s->length == name.size() &&
+            !memcmp(s->name, name.data(), name.size()))
+            return s;
+    }
+    return nullptr;
+}
@@ -0,0 +1,110 @@
+#ifndef PROFILES_HPP
+#define PROFILES_HPP
+
+#include "color/rgb.hpp"
+#include "fs.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef DATA_PREFIX
+#define DATA_PREFIX "/var/lib/system76-kbd-led/"
+#endif
+
+#define PROFILES_PATH JOIN(DATA_PREFIX, "profiles")
+
+namespace fs
+{
+
+// A named lighting preset.
+struct profile {
+    std::array<color::rgb, 4> colors;
+    uint32_t brightness = 0;
+};
+
+/**
+ * @brief Named profiles in a single memory-mapped, hash-indexed file.
+ *
+ * The file is a fixed header followed by a power-of-two table of
+ * fixed-size slots, addressed by the FNV-1a hash of the profile name
+ * with linear probing. Looking a profile up maps the file and touches
+ * one or two slots no matter how many profiles there are; nothing is
+ * parsed. Mutations are done in place under an exclusive flock(2); when
+ * the table gets too full it is rebuilt at twice the size into a
+ * temporary file that is renamed over the old one.
+ **/
+class profile_store
+{
+public:
+    // Longest accepted profile name, in bytes.
+    static constexpr std::size_t max_name = 55;
+
+private:
+    std::string m_path;
+    bool m_writable;
+    int m_fd = -1;
+    void *m_map = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    /**
+     * @brief Open the store at path.
+     *
+     * A missing store reads as empty; a writable store is created on
+     * first use.
+     *
+     * @throws std::system_error on I/O errors, std::runtime_error if
+     *         the file isn't a profile store.
+     **/
+    explicit profile_store(std::string path = PROFILES_PATH,
+                           bool writable = false);
+    ~profile_store(void);
+
+    profile_store(const profile_store &) = delete;
+    profile_store &operator=(const profile_store &) = delete;
+
+    std::optional<profile> find(std::string_view name) const;
+
+    /**
+     * @brief Create or replace the profile called name.
+     *
+     * @throws std::invalid_argument if name is empty or too long.
+     **/
+    void save(std::string_view name, const profile &p);
+
+    // Returns false if there was no profile called name.
+    bool remove(std::string_view name);
+
+    // Every profile name, in table order.
+    std::vector<std::string> list(void) const;
+
+private:
+    struct header;
+    struct slot;
+
+    void open(void);
+
+    // Another writer may have replaced the file while we waited for the
+    // lock; switch to the one at m_path, taking the lock along.
+    void follow(void);
+
+    void map(void);
+    void unmap(void);
+
+    // Replace the file with an empty table, or a larger copy of this
+    // one, and switch to it. Called with the lock held.
+    void create(uint32_t capacity);
+    void grow(void);
+    void adopt(int fd);
+
+    header *table(void) const;
+    slot *slots(void) const;
+    slot *lookup(std::string_view name, uint32_t hash) const;
+};
+
+}; // namespace fs
+
+#endif /* PROFILES_HPP */
@@ -0,0 +1,399 @@
+#include "schedule.hpp"
+#include "args.hpp"
+#include "clock.hpp"
+#include "color/hex.hpp"
+#include "color/space.hpp"
+#include "fade.hpp"
+#include "logging.hpp"
+#include "signals.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace schedule;
+
+static const char *const day_names[] = {"sun", "mon", "tue", "wed",
+                                        "thu", "fri", "sat"};
+
+static bool parse_day(std::string_view s, int &day)
+{
+    for (day = 0; day < 7; ++day) {
+        if (s == day_names[day])
+            return true;
+    }
+    return false;
+}
+
+// "*", or days and day ranges separated by commas; ranges may wrap
+// around the end of the week ("fri-mon").
+static bool parse_days(std::string_view s, uint8_t &days)
+{
+    if (s == "*") {
+        days = every_day;
+        return true;
+    }
+
+    days = 0;
+    while (!s.empty()) {
+        auto comma = s.find(',');
+        auto item = s.substr(0, comma);
+        s = comma == s.npos ? std::string_view() : s.substr(comma + 1);
+        if (item.empty() || (comma != s.npos && s.empty()))
+            return false;
+
+        int first, last;
+        auto dash = item.find('-');
+        if (!parse_day(item.substr(0, dash), first))
+            return false;
+        last = first;
+        if (dash != item.npos && !parse_day(item.substr(dash + 1), last))
+            return false;
+
+        for (int d = first;; d = (d + 1) % 7) {
+            days |= 1 << d;
+            if (d == last)
+                break;
+        }
+    }
+    return days;
+}
+
+// "HH:MM", 00:00 through 24:00; minutes since midnight.
+static bool parse_time(std::string_view s, uint16_t &minutes)
+{
+    unsigned h, m;
+    if (s.size() != 5 || s[2] != ':')
+        return false;
+    auto a = std::from_chars(s.data(), s.data() + 2, h);
+    auto b = std::from_chars(s.data() + 3, s.data() + 5, m);
+    if (a.ec != std::errc() || a.ptr != s.data() + 2 ||
+        b.ec != std::errc() || b.ptr != s.data() + 5 || m > 59 ||
+        h > 24 || (h == 24 && m))
+        return false;
+    minutes = (h * 60 + m) % (24 * 60);
+    return true;
+}
+
+static bool parse_window(std::string_view s, rule &r)
+{
+    auto dash = s.find('-');
+    return dash != s.npos && parse_time(s.substr(0, dash), r.start) &&
+           parse_time(s.substr(dash + 1), r.end);
+}
+
+static bool parse_color(std::istringstream &ss, color::rgb &c)
+{
+    std::string token;
+    if (!(ss >> token))
+        return false;
+    auto value = color::hex::decode(token);
+    if (value)
+        c = color::rgb(*value);
+    return value.has_value();
+}
+
+plan schedule::load(const std::string &path,
+                    const fs::profile_store &profiles)
+{
+    std::ifstream ifs(path);
+    if (!ifs)
+        throw std::runtime_error("Unable to read schedule " + path + ".");
+
+    plan p;
+    std::string line;
+    for (std::size_t n = 1; std::getline(ifs, line); ++n) {
+        std::istringstream ss(line);
+        std::string first;
+        if (!(ss >> first) || first[0] == '#')
+            continue;
+
+        auto where = path + ":" + std::to_string(n);
+        auto malformed = [&] {
+            return std::runtime_error("Malformed schedule " + where + ".");
+        };
+
+        if (first == "fade") {
+            double seconds;
+            std::string token, rest;
+            if (!(ss >> token) || !args::to_real(token, seconds) ||
+                seconds < 0 ||
+                seconds * 1000.0 > std::numeric_limits<uint32_t>::max() ||
+                ss >> rest)
+                throw malformed();
+            p.fade = std::chrono::milliseconds(std::lround(seconds * 1000));
+            continue;
+        }
+
+        rule r;
+        std::string window;
+        if (!parse_days(first, r.days) || !(ss >> window) ||
+            !parse_window(window, r))
+            throw malformed();
+
+        std::string key;
+        while (ss >> key) {
+            if (key == "color") {
+                color::rgb c;
+                if (!parse_color(ss, c))
+                    throw malformed();
+                r.colors = {c, c, c, c};
+            } else if (key == "colors") {
+                std::array<color::rgb, 4> colors;
+                for (auto &c : colors) {
+                    if (!parse_color(ss, c))
+                        throw malformed();
+                }
+                r.colors = colors;
+            } else if (key == "brightness") {
+                std::string token;
+                uint32_t level;
+                if (!(ss >> token))
+                    throw malformed();
+                auto [end, ec] = std::from_chars(
+                    token.data(), token.data() + token.size(), level);
+                if (ec != std::errc() || end != token.data() + token.size())
+                    throw malformed();
+                r.level = level;
+            } else if (key == "profile") {
+                std::string name;
+                if (!(ss >> name))
+                    throw malformed();
+                auto found = profiles.find(name);
+                if (!found)
+                    throw std::runtime_error("No profile named '" + name +
+                                             "' at " + where + ".");
+                r.colors = found->colors;
+                r.level = found->brightness;
+            } else {
+                throw malformed();
+            }
+        }
+        if (!r.colors && !r.level)
+            throw malformed();
+        p.rules.push_back(r);
+    }
+    return p;
+}
+
+bool look::operator==(const look &other) const
+{
+    return colors == other.colors && level == other.level;
+}
+
+bool look::operator!=(const look &other) const
+{
+    return !(*this == other);
+}
+
+bool schedule::active(const rule &r, const std::tm &t)
+{
+    const int minute = t.tm_hour * 60 + t.tm_min;
+    const bool today = r.days & (1 << t.tm_wday);
+    if (r.start < r.end)
+        return today && minute >= r.start && minute < r.end;
+
+    // Past midnight, the window belongs to the day before.
+    const bool yesterday = r.days & (1 << (t.tm_wday + 6) % 7);
+    return (today && minute >= r.start) || (yesterday && minute < r.end);
+}
+
+static std::tm local(std::time_t t)
+{
+    std::tm tm;
+    localtime_r(&t, &tm);
+    return tm;
+}
+
+// Which rules cover t, as one flag per rule.
+static std::vector<bool> matches(const plan &p, std::time_t t)
+{
+    auto tm = local(t);
+    std::vector<bool> out(p.rules.size());
+    for (std::size_t i = 0; i < p.rules.size(); ++i)
+        out[i] = active(p.rules[i], tm);
+    return out;
+}
+
+look schedule::resolve(const plan &p, std::time_t t, const look &base)
+{
+    look l = base;
+    auto tm = local(t);
+    for (auto &r : p.rules) {
+        if (!active(r, tm))
+            continue;
+        if (r.colors)
+            l.colors = *r.colors;
+        if (r.level)
+            l.level = *r.level;
+    }
+    return l;
+}
+
+std::time_t schedule::next_change(const plan &p, std::time_t t)
+{
+    constexpr std::time_t week = 7 * 24 * 60 * 60;
+
+    // Every window boundary from yesterday until a week out, in local
+    // time; mktime() sorts out month ends and daylight saving.
+    const auto today = local(t);
+    std::vector<std::time_t> times;
+    for (int day = -1; day <= 8; ++day) {
+        for (auto &r : p.rules) {
+            for (uint16_t minute : {r.start, r.end}) {
+                std::tm tm = today;
+                tm.tm_mday += day;
+                tm.tm_hour = minute / 60;
+                tm.tm_min = minute % 60;
+                tm.tm_sec = 0;
+                tm.tm_isdst = -1;
+                std::time_t when = mktime(&tm);
+                if (when > t && when <= t + week)
+                    times.push_back(when);
+            }
+        }
+    }
+    std::sort(times.begin(), times.end());
+
+    // A boundary on a day a rule doesn't apply on changes nothing.
+    const auto now = matches(p, t);
+    for (auto when : times) {
+        if (matches(p, when) != now)
+            return when;
+    }
+    return t + week;
+}
+
+// A CLOCK_REALTIME timerfd, armed for one absolute time at once.
+class timer
+{
+private:
+    int m_fd;
+
+public:
+    timer(void)
+        : m_fd(timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC))
+    {
+        if (m_fd == -1)
+            throw std::system_error(errno, std::generic_category(),
+                                    "timerfd_create");
+    }
+
+    ~timer(void)
+    {
+        close(m_fd);
+    }
+
+    timer(const timer &) = delete;
+    timer &operator=(const timer &) = delete;
+
+    // Sleep until at, a clock change or a signal, whichever is first.
+    void wait_until(std::time_t at)
+    {
+        itimerspec spec{};
+        spec.it_value.tv_sec = at;
+        if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                            &spec, nullptr) == -1)
+            throw std::system_error(errno, std::generic_category(),
+                                    "timerfd_settime");
+
+        // ECANCELED (the clock was set) and EINTR need nothing more
+        // than another look at the time.
+        uint64_t expirations;
+        if (read(m_fd, &expirations, sizeof(expirations)) == -1 &&
+            errno == ECANCELED)
+            logging::debug("Clock changed; recomputing the schedule.");
+    }
+};
+
+static void commit(app::state &st)
+{
+    st.kb.commit(st.batch);
+    st.brightness.commit(st.batch);
+    app::submit(st);
+}
+
+// Step from one look to the other over duration, then apply the last
+// one as a request.
+static void crossfade(app::state &st, const look &from, const look &to,
+                      std::chrono::milliseconds duration)
+{
+    if (duration.count() > 0) {
+        const led::curve<uint32_t> c(st.brightness.max_level());
+        const double start = c.lightness(from.level);
+        const double end = c.lightness(to.level);
+        const double total = std::chrono::duration<double>(duration).count();
+
+        std::array<color::rgb, 4> colors;
+        timing::frame_clock clock(30);
+        while (signals::running()) {
+            if (!clock.wait())
+                continue;
+            double t = std::chrono::duration<double>(clock.elapsed()).count() /
+                       total;
+            if (t >= 1.0)
+                break;
+
+            for (std::size_t i = 0; i < colors.size(); ++i)
+                colors[i] = color::mix(from.colors[i], to.colors[i], t,
+                                       color::space::oklab);
+            st.kb.stage(colors);
+            st.brightness.stage_value(c.level(start + (end - start) * t));
+            commit(st);
+        }
+    }
+
+    app::request req;
+    req.flags = app::request::left | app::request::center |
+                app::request::right | app::request::extra |
+                app::request::brightness | app::request::quiet;
+    for (std::size_t i = 0; i < to.colors.size(); ++i)
+        color::hex::encode(req.colors[i], to.colors[i].value());
+    req.level = to.level;
+
+    auto res = app::run(st, req);
+    if (res.status)
+        throw std::runtime_error(res.error);
+    st.cache.file.flush();
+}
+
+// time(2) can read a coarse clock a tick behind the timer that just
+// fired; ask for the precise one.
+static std::time_t current_time(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec;
+}
+
+std::size_t schedule::run(const plan &p, app::state &st)
+{
+    signals::install();
+
+    look shown{st.kb.regions(), st.brightness.level()};
+    const look base = shown;
+
+    timer t;
+    std::size_t transitions = 0;
+    while (signals::running()) {
+        std::time_t now = current_time();
+        look target = resolve(p, now, base);
+        if (target != shown) {
+            crossfade(st, shown, target, p.fade);
+            shown = target;
+            ++transitions;
+        }
+
+        std::time_t next = next_change(p, now);
+        logging::debug("Next schedule change in", next - now, " seconds.");
+        t.wait_until(next);
+    }
+    return transitions;
+}
@@ -0,0 +1,106 @@
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include "app.hpp"
+#include "profiles.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace schedule
+{
+
+// Weekdays a rule applies on: bit i for tm_wday i, Sunday being 0.
+enum : uint8_t { every_day = 0x7f };
+
+/**
+ * @brief A time window and what the keyboard looks like during it.
+ **/
+struct rule {
+    uint8_t days = every_day;
+
+    // Minutes since midnight. A window whose end isn't after its start
+    // runs past midnight into the next day; days names the day it
+    // starts on.
+    uint16_t start = 0;
+    uint16_t end = 0;
+
+    // Whatever is left unset stays as it was.
+    std::optional<std::array<color::rgb, 4>> colors;
+    std::optional<uint32_t> level;
+};
+
+struct plan {
+    // Later rules win where windows overlap.
+    std::vector<rule> rules;
+
+    // How long moving from one look to the next takes.
+    std::chrono::milliseconds fade{0};
+};
+
+// Colors and brightness at one time.
+struct look {
+    std::array<color::rgb, 4> colors;
+    uint32_t level = 0;
+
+    bool operator==(const look &other) const;
+    bool operator!=(const look &other) const;
+};
+
+/**
+ * @brief Load the schedule at path.
+ *
+ * Each non-blank line not starting with '#' is either "fade <seconds>"
+ * or a rule:
+ *
+ *   <days> <HH:MM>-<HH:MM> <setting>...
+ *
+ * where days is "*" or a comma-separated list of days and day ranges
+ * ("mon-fri,sun"), and each setting is one of "color <rgb>" (every
+ * region), "colors <left> <center> <right> <extra>", "brightness <n>"
+ * or "profile <name>". Profiles are looked up in profiles once, here.
+ *
+ * @throws std::runtime_error naming the line of a malformed rule.
+ **/
+plan load(const std::string &path, const fs::profile_store &profiles);
+
+// Whether r covers local time t.
+bool active(const rule &r, const std::tm &t);
+
+// The look at time t: base, overlaid by every rule covering t in turn.
+look resolve(const plan &p, std::time_t t, const look &base);
+
+/**
+ * @brief The first time after t at which the rules covering it change.
+ *
+ * Window boundaries are worked out in local time for each day, so
+ * daylight saving shifts are followed. When nothing changes within a
+ * week, a week from t is returned.
+ **/
+std::time_t next_change(const plan &p, std::time_t t);
+
+/**
+ * @brief Follow p on st until SIGINT or SIGTERM.
+ *
+ * The keyboard's look when this is called is the base that applies
+ * outside every window. Between transitions the process sleeps on a
+ * single CLOCK_REALTIME timerfd armed for the next one, with
+ * TFD_TIMER_CANCEL_ON_SET so that a clock change (NTP stepping it, the
+ * user setting it, a resume) wakes it up to work everything out again.
+ * Nothing wakes up periodically.
+ *
+ * Each new look is cross-faded to over p.fade, mixing colors in OKLab
+ * and brightness in lightness, and then applied like any other request
+ * so the caches follow.
+ *
+ * @returns The number of transitions made.
+ **/
+std::size_t run(const plan &p, app::state &st);
+
+}; // namespace schedule
+
+#endif /* SCHEDULE_HPP */
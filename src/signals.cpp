@@ -0,0 +1,24 @@
+#include "signals.hpp"
+#include <csignal>
+#include <cstring>
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+    stop = 1;
+}
+
+void signals::install(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+bool signals::running(void)
+{
+    return !stop;
+}
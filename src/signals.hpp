@@ -0,0 +1,20 @@
+#ifndef SIGNALS_HPP
+#define SIGNALS_HPP
+
+namespace signals
+{
+
+/**
+ * @brief Route SIGINT and SIGTERM to a stop flag.
+ *
+ * Handlers are installed without SA_RESTART, so a blocking call in a
+ * long-running loop returns EINTR and the loop gets to check running().
+ **/
+void install(void);
+
+// False once SIGINT or SIGTERM has been received.
+bool running(void);
+
+}; // namespace signals
+
+#endif /* SIGNALS_HPP */
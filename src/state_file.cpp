@@ -0,0 +1,195 @@
+#include "state_file.hpp"
+#include "color/hex.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace fs;
+
+// Legacy one-value-per-file caches, imported on first use.
+#define LEGACY_BRIGHTNESS_CACHE JOIN(CACHE_PREFIX, "brightness")
+#define LEGACY_HW_BRIGHTNESS_CACHE JOIN(CACHE_PREFIX, "hw_brightness")
+#define LEGACY_COLOR_CACHE JOIN(CACHE_PREFIX, "colors")
+
+static uint32_t checksum(const state_file::record &r)
+{
+    auto *p = reinterpret_cast<const unsigned char *>(&r);
+    uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < offsetof(state_file::record, checksum); ++i)
+        hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+state_file::state_file(std::string path)
+    : m_path(std::move(path))
+{
+    load();
+}
+
+state_file::~state_file(void)
+{
+    try {
+        flush();
+    } catch (std::system_error &e) {
+        logging::error("Unable to save state:", e.what());
+    }
+}
+
+bool state_file::has(field f) const
+{
+    return m_record.present & f;
+}
+
+std::optional<uint32_t> state_file::level(field f) const
+{
+    if (!has(f))
+        return std::nullopt;
+    return f == brightness ? m_record.brightness : m_record.hw_brightness;
+}
+
+void state_file::set_level(field f, uint32_t value)
+{
+    if (level(f) == value)
+        return;
+
+    (f == brightness ? m_record.brightness : m_record.hw_brightness) = value;
+    m_record.present |= f;
+    m_dirty = true;
+}
+
+std::optional<std::array<uint32_t, 4>> state_file::region_colors(void) const
+{
+    if (!has(field::colors))
+        return std::nullopt;
+
+    std::array<uint32_t, 4> values;
+    memcpy(values.data(), m_record.colors, sizeof(m_record.colors));
+    return values;
+}
+
+void state_file::set_region_colors(const std::array<uint32_t, 4> &values)
+{
+    if (region_colors() == values)
+        return;
+
+    memcpy(m_record.colors, values.data(), sizeof(m_record.colors));
+    m_record.present |= field::colors;
+    m_dirty = true;
+}
+
+bool state_file::dirty(void) const
+{
+    return m_dirty;
+}
+
+void state_file::flush(void)
+{
+    if (!m_dirty)
+        return;
+
+    m_record.checksum = checksum(m_record);
+
+    // The whole replacement, open(2) through rename(2), counts as one
+    // write of the state file.
+    auto *stats = metrics::lookup(m_path);
+    uint64_t started = metrics::now();
+
+    // A temporary file of our own: one-shot runs may flush at the same
+    // time, and a shared name would let one truncate the other's.
+    std::string tmp = m_path + ".XXXXXX";
+    int fd = mkostemp(tmp.data(), O_CLOEXEC);
+    if (fd == -1) {
+        int error = errno;
+        metrics::record(stats, metrics::op::write, started, false);
+        throw std::system_error(error, std::generic_category(), tmp);
+    }
+
+    ssize_t rc = -1;
+    if (fchmod(fd, 0644) == 0)
+        rc = ::write(fd, &m_record, sizeof(m_record));
+    int error = rc == -1 ? errno : EIO;
+    ::close(fd);
+
+    if (rc != static_cast<ssize_t>(sizeof(m_record))) {
+        unlink(tmp.c_str());
+        metrics::record(stats, metrics::op::write, started, false);
+        throw std::system_error(error, std::generic_category(), tmp);
+    }
+
+    if (rename(tmp.c_str(), m_path.c_str()) == -1) {
+        error = errno;
+        unlink(tmp.c_str());
+        metrics::record(stats, metrics::op::write, started, false);
+        throw std::system_error(error, std::generic_category(), m_path);
+    }
+    metrics::record(stats, metrics::op::write, started, true);
+    m_dirty = false;
+}
+
+const std::string &state_file::path(void) const
+{
+    return m_path;
+}
+
+void state_file::load(void)
+{
+    auto *stats = metrics::lookup(m_path);
+    uint64_t started = metrics::now();
+
+    // A state file that doesn't exist yet isn't a failure.
+    int fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    int error = errno;
+    metrics::record(stats, metrics::op::open, started,
+                    fd != -1 || error == ENOENT);
+    if (fd == -1) {
+        if (error == ENOENT)
+            import_legacy();
+        return;
+    }
+
+    // Read one byte more than a record to catch trailing garbage.
+    record r;
+    char buf[sizeof(record) + 1];
+    started = metrics::now();
+    ssize_t rc = ::read(fd, buf, sizeof(buf));
+    metrics::record(stats, metrics::op::read, started, rc != -1);
+    ::close(fd);
+
+    if (rc == static_cast<ssize_t>(sizeof(record))) {
+        memcpy(&r, buf, sizeof(r));
+        if (!memcmp(r.magic, record().magic, sizeof(r.magic)) &&
+            r.version == version && r.checksum == checksum(r)) {
+            m_record = r;
+            return;
+        }
+    }
+
+    logging::warn("Discarding corrupt state file", m_path);
+}
+
+void state_file::import_legacy(void)
+{
+    cache<uint32_t> level(LEGACY_BRIGHTNESS_CACHE);
+    if (auto value = level.data())
+        set_level(brightness, *value);
+
+    cache<uint32_t> hw_level(LEGACY_HW_BRIGHTNESS_CACHE);
+    if (auto value = hw_level.data())
+        set_level(hw_brightness, *value);
+
+    cache<std::string> legacy_colors(LEGACY_COLOR_CACHE);
+    if (auto s = legacy_colors.data()) {
+        std::array<uint32_t, 4> values;
+        if (s->size() == values.size() * color::hex::width &&
+            color::hex::decode_batch(s->data(), values.size(),
+                                     values.data()))
+            set_region_colors(values);
+    }
+}
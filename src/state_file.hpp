@@ -0,0 +1,132 @@
+#ifndef STATE_FILE_HPP
+#define STATE_FILE_HPP
+
+#include "cache.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#define STATE_PATH JOIN(CACHE_PREFIX, "state")
+
+namespace fs
+{
+
+/**
+ * @brief Every cached value in one small, checksummed binary file.
+ *
+ * The file is read once on construction. Setters only touch memory and
+ * mark the state dirty; flush() writes the whole record to a temporary
+ * file and rename(2)s it into place, so readers never observe a torn
+ * write. A record with a bad magic, version, size or checksum is
+ * reported and discarded rather than half-parsed.
+ *
+ * When no state file exists yet, the legacy one-file-per-value caches
+ * (brightness, hw_brightness, colors) are imported from the same
+ * directory.
+ **/
+class state_file
+{
+public:
+    enum field : uint16_t {
+        brightness = 1 << 0,
+        hw_brightness = 1 << 1,
+        colors = 1 << 2,
+    };
+
+    // Bumped whenever record's layout changes.
+    static constexpr uint16_t version = 1;
+
+    // On-disk layout, in host byte order.
+    struct record {
+        char magic[4] = {'S', '7', '6', 'K'};
+        uint16_t version = state_file::version;
+
+        // Bitmask of fields holding a value.
+        uint16_t present = 0;
+
+        uint32_t brightness = 0;
+        uint32_t hw_brightness = 0;
+
+        // Packed 0xRRGGBB values; left, center, right, extra.
+        uint32_t colors[4] = {};
+
+        // FNV-1a of every byte above.
+        uint32_t checksum = 0;
+    };
+
+private:
+    std::string m_path;
+    record m_record;
+    bool m_dirty = false;
+
+public:
+    explicit state_file(std::string path = STATE_PATH);
+
+    // Flushes any pending changes.
+    ~state_file(void);
+
+    state_file(const state_file &) = delete;
+    state_file &operator=(const state_file &) = delete;
+
+    bool has(field f) const;
+
+    std::optional<uint32_t> level(field f) const;
+    void set_level(field f, uint32_t value);
+
+    std::optional<std::array<uint32_t, 4>> region_colors(void) const;
+    void set_region_colors(const std::array<uint32_t, 4> &values);
+
+    // Whether there are changes flush() would write.
+    bool dirty(void) const;
+
+    /**
+     * @brief Atomically replace the state file if anything changed.
+     *
+     * @throws std::system_error if the file can't be written.
+     **/
+    void flush(void);
+
+    const std::string &path(void) const;
+
+private:
+    void load(void);
+    void import_legacy(void);
+};
+
+/**
+ * @brief A single brightness level kept in a state_file.
+ **/
+template <typename T, state_file::field F>
+class level_cache
+{
+private:
+    state_file &m_file;
+
+public:
+    explicit level_cache(state_file &file)
+        : m_file(file)
+    {
+    }
+
+    bool exists(void) const
+    {
+        return m_file.has(F);
+    }
+
+    std::optional<T> data(void) const
+    {
+        if (auto value = m_file.level(F))
+            return static_cast<T>(*value);
+        return std::nullopt;
+    }
+
+    void set_data(T data)
+    {
+        m_file.set_level(F, static_cast<uint32_t>(data));
+    }
+};
+
+}; // namespace fs
+
+#endif /* STATE_FILE_HPP */
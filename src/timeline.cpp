@@ -0,0 +1,396 @@
+#include "timeline.hpp"
+#include "args.hpp"
+#include "clock.hpp"
+#include "color/hex.hpp"
+#include "signals.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+using namespace timeline;
+
+static constexpr char magic[4] = {'S', '7', '6', 'T'};
+static constexpr uint16_t version = 1;
+
+[[noreturn]] static void fail(int error, const std::string &path)
+{
+    throw std::system_error(error, std::generic_category(), path);
+}
+
+static void write_all(int fd, const void *buf, std::size_t size,
+                      off_t offset, const std::string &path)
+{
+    auto *p = static_cast<const char *>(buf);
+    while (size) {
+        ssize_t rc = pwrite(fd, p, size, offset);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1)
+            fail(errno, path);
+        p += rc;
+        size -= rc;
+        offset += rc;
+    }
+}
+
+static bool parse_time(const std::string &s, uint32_t &ms)
+{
+    double seconds;
+    if (!args::to_real(s, seconds) || seconds < 0 ||
+        seconds * 1000.0 > std::numeric_limits<uint32_t>::max())
+        return false;
+    ms = std::lround(seconds * 1000.0);
+    return true;
+}
+
+static bool parse_keyframe(std::istringstream &ss, const std::string &first,
+                           keyframe &k)
+{
+    memset(&k, 0, sizeof(k));
+    k.mode = interpolation::linear;
+    if (!parse_time(first, k.time))
+        return false;
+
+    std::string token;
+    for (auto &c : k.colors) {
+        std::optional<uint32_t> value;
+        if (!(ss >> token) || !(value = color::hex::decode(token)))
+            return false;
+        c = *value;
+    }
+
+    if (!(ss >> token))
+        return false;
+    auto [end, ec] = std::from_chars(token.data(),
+                                     token.data() + token.size(), k.level);
+    if (ec != std::errc() || end != token.data() + token.size())
+        return false;
+
+    if (ss >> token) {
+        if (token == "step")
+            k.mode = interpolation::step;
+        else if (token == "smooth")
+            k.mode = interpolation::smooth;
+        else if (token != "linear")
+            return false;
+    }
+    return !(ss >> token);
+}
+
+void timeline::compile(const std::string &src, const std::string &dst)
+{
+    std::ifstream ifs(src);
+    if (!ifs)
+        throw std::runtime_error("Unable to read timeline " + src + ".");
+
+    auto tmp = dst + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd == -1)
+        fail(errno, tmp);
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+
+    try {
+        // Keyframes are streamed out in chunks, so compiling doesn't
+        // hold the whole show either.
+        std::vector<keyframe> chunk;
+        chunk.reserve(256);
+        off_t offset = sizeof(header);
+        auto flush = [&] {
+            std::size_t size = chunk.size() * sizeof(keyframe);
+            write_all(fd, chunk.data(), size, offset, tmp);
+            offset += size;
+            chunk.clear();
+        };
+
+        std::string line;
+        for (std::size_t n = 1; std::getline(ifs, line); ++n) {
+            std::istringstream ss(line);
+            std::string first;
+            if (!(ss >> first) || first[0] == '#')
+                continue;
+
+            auto where = src + ":" + std::to_string(n);
+            if (first == "loop") {
+                if (ss >> first)
+                    throw std::runtime_error("Malformed timeline " + where +
+                                             ".");
+                h.flags |= looping;
+                continue;
+            }
+
+            keyframe k;
+            if (!parse_keyframe(ss, first, k))
+                throw std::runtime_error("Malformed timeline " + where + ".");
+            if (h.count && k.time <= h.duration)
+                throw std::runtime_error("Keyframe at " + where +
+                                         " isn't later than the one before.");
+
+            h.duration = k.time;
+            ++h.count;
+            chunk.push_back(k);
+            if (chunk.size() == chunk.capacity())
+                flush();
+        }
+        flush();
+
+        if (!h.count)
+            throw std::runtime_error("Timeline " + src + " has no keyframes.");
+        if ((h.flags & looping) && !h.duration)
+            throw std::runtime_error("Looping timeline " + src +
+                                     " needs more than one instant.");
+
+        write_all(fd, &h, sizeof(h), 0, tmp);
+        if (::close(fd) == -1) {
+            fd = -1;
+            fail(errno, tmp);
+        }
+        fd = -1;
+        if (rename(tmp.c_str(), dst.c_str()) == -1)
+            fail(errno, dst);
+    } catch (...) {
+        if (fd != -1)
+            ::close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+}
+
+show::show(const std::string &path)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1)
+        fail(errno, path);
+
+    struct stat st;
+    if (fstat(m_fd, &st) == -1) {
+        int error = errno;
+        ::close(m_fd);
+        fail(error, path);
+    }
+
+    if (static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+        ::close(m_fd);
+        throw std::runtime_error(path + " is not a compiled timeline.");
+    }
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (p == MAP_FAILED) {
+        int error = errno;
+        ::close(m_fd);
+        fail(error, path);
+    }
+    m_map = p;
+    m_size = st.st_size;
+
+    // Playback walks the file front to back: read ahead eagerly, and
+    // don't bother keeping what's behind.
+    madvise(m_map, m_size, MADV_SEQUENTIAL);
+
+    auto *h = head();
+    bool valid = !memcmp(h->magic, magic, sizeof(magic)) &&
+                 h->version == version && h->count &&
+                 m_size == sizeof(header) + std::size_t(h->count) *
+                                                sizeof(keyframe);
+
+    // Hold the file to what compile() guarantees: strictly increasing
+    // times ending at the duration, and a loop longer than an instant.
+    if (valid)
+        valid = !((h->flags & looping) && !h->duration) &&
+                (*this)[h->count - 1].time == h->duration;
+    for (std::size_t i = 1; valid && i < h->count; ++i)
+        valid = (*this)[i - 1].time < (*this)[i].time;
+    if (!valid) {
+        munmap(m_map, m_size);
+        ::close(m_fd);
+        throw std::runtime_error(path + " is not a compiled timeline.");
+    }
+    release(h->count);
+}
+
+show::~show(void)
+{
+    munmap(m_map, m_size);
+    ::close(m_fd);
+}
+
+std::size_t show::size(void) const
+{
+    return head()->count;
+}
+
+uint32_t show::duration(void) const
+{
+    return head()->duration;
+}
+
+bool show::loops(void) const
+{
+    return head()->flags & looping;
+}
+
+const keyframe &show::operator[](std::size_t i) const
+{
+    auto *base = static_cast<const char *>(m_map) + sizeof(header);
+    return reinterpret_cast<const keyframe *>(base)[i];
+}
+
+void show::release(std::size_t i) const
+{
+    // Keep the page holding the header and keyframe i.
+    static const std::size_t page = sysconf(_SC_PAGESIZE);
+    std::size_t end = (sizeof(header) + i * sizeof(keyframe)) / page * page;
+    if (end > page)
+        madvise(static_cast<char *>(m_map) + page, end - page, MADV_DONTNEED);
+}
+
+const header *show::head(void) const
+{
+    return static_cast<const header *>(m_map);
+}
+
+bool frame::operator==(const frame &other) const
+{
+    return colors == other.colors && level == other.level;
+}
+
+bool frame::operator!=(const frame &other) const
+{
+    return !(*this == other);
+}
+
+// a + (b - a) * w / 65536 per channel.
+static uint32_t blend(uint32_t a, uint32_t b, uint32_t w)
+{
+    uint32_t out = 0;
+    for (unsigned shift = 0; shift < 24; shift += 8) {
+        int32_t x = (a >> shift) & 0xff;
+        int32_t y = (b >> shift) & 0xff;
+        int32_t c = x + (((y - x) * int32_t(w) + 32768) >> 16);
+        out |= uint32_t(c) << shift;
+    }
+    return out;
+}
+
+std::size_t timeline::sample(const show &s, uint32_t ms, std::size_t hint,
+                             frame &out)
+{
+    const std::size_t count = s.size();
+    std::size_t i = hint < count && s[hint].time <= ms ? hint : 0;
+    while (i + 1 < count && s[i + 1].time <= ms)
+        ++i;
+
+    const keyframe &a = s[i];
+    uint32_t w = 0;
+    if (i + 1 < count && ms > a.time && a.mode != interpolation::step) {
+        const keyframe &b = s[i + 1];
+        double f = double(ms - a.time) / (b.time - a.time);
+        if (a.mode == interpolation::smooth)
+            f = f * f * (3.0 - 2.0 * f);
+        w = std::lround(f * 65536.0);
+    }
+
+    if (!w) {
+        for (std::size_t c = 0; c < 4; ++c)
+            out.colors[c] = color::rgb(a.colors[c]);
+        out.level = a.level;
+        return i;
+    }
+
+    const keyframe &b = s[i + 1];
+    for (std::size_t c = 0; c < 4; ++c)
+        out.colors[c] = color::rgb(blend(a.colors[c], b.colors[c], w));
+    int64_t delta = int64_t(b.level) - a.level;
+    out.level = a.level + (delta * w + 32768) / 65536;
+    return i;
+}
+
+player::player(color::keyboard &kb, led::brightness<uint32_t> &brightness,
+               fs::batch &batch)
+    : m_kb(kb)
+    , m_brightness(brightness)
+    , m_batch(batch)
+{
+}
+
+fs::commit_stats player::commit(void)
+{
+    auto stats = m_kb.commit(m_batch);
+    stats += m_brightness.commit(m_batch);
+    try {
+        m_batch.submit();
+    } catch (...) {
+        m_kb.forget();
+        m_brightness.reload();
+        throw;
+    }
+    return stats;
+}
+
+effects::stats player::run(const show &s, const effects::params &base,
+                           unsigned fps)
+{
+    signals::install();
+
+    effects::stats st;
+    frame f, last;
+    bool first = true;
+    std::size_t index = 0;
+    timing::frame_clock clock(fps);
+
+    while (signals::running()) {
+        uint64_t elapsed = clock.wait();
+        if (!elapsed)
+            continue;
+        st.dropped += elapsed - 1;
+
+        uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          clock.elapsed())
+                          .count();
+        bool done = !s.loops() && ms >= s.duration();
+        if (s.loops())
+            ms %= s.duration();
+        else
+            ms = std::min<uint64_t>(ms, s.duration());
+
+        std::size_t next = sample(s, ms, index, f);
+        if (next / 256 != index / 256)
+            s.release(next);
+        index = next;
+
+        ++st.frames;
+        if (first || last != f) {
+            m_kb.stage(f.colors);
+            m_brightness.stage_value(f.level);
+            st.writes += commit();
+            std::swap(last, f);
+            first = false;
+        } else {
+            ++st.unchanged;
+        }
+
+        if (done)
+            return st;
+    }
+
+    m_kb.stage(base.colors);
+    m_brightness.stage_value(base.level);
+    st.writes += commit();
+    return st;
+}
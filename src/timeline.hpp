@@ -0,0 +1,164 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include "batch.hpp"
+#include "brightness.hpp"
+#include "effects.hpp"
+#include "keyboard.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace timeline
+{
+
+// How a keyframe blends into the one after it.
+enum class interpolation : uint8_t {
+    step,   // Hold this keyframe until the next one.
+    linear, // Blend at a constant rate.
+    smooth, // Blend along a smoothstep curve, easing in and out.
+};
+
+/**
+ * The compiled format, in host byte order: a header followed by
+ * count keyframes sorted by strictly increasing time.
+ **/
+struct header {
+    char magic[4];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t count;
+
+    // Length of the show in milliseconds; the last keyframe's time.
+    uint32_t duration;
+};
+
+enum : uint16_t { looping = 1 };
+
+struct keyframe {
+    // Milliseconds from the start of the show.
+    uint32_t time;
+
+    // Packed 0xRRGGBB region colors: left, center, right, extra.
+    uint32_t colors[4];
+
+    uint32_t level;
+    interpolation mode;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(header) == 16 && sizeof(keyframe) == 28,
+              "the timeline format is fixed-size");
+
+/**
+ * @brief Compile the text timeline at src into the binary one at dst.
+ *
+ * Each non-blank line of src not starting with '#' is either the word
+ * "loop", or a keyframe:
+ *
+ *   <seconds> <left> <center> <right> <extra> <brightness> [<mode>]
+ *
+ * with colors as six hex digits and mode one of step, linear (the
+ * default) or smooth. dst is replaced atomically.
+ *
+ * @throws std::runtime_error naming the line of a malformed keyframe.
+ * @throws std::system_error if a file can't be read or written.
+ **/
+void compile(const std::string &src, const std::string &dst);
+
+/**
+ * @brief A compiled timeline, mapped read-only.
+ *
+ * Opening checks the header and makes one sequential pass over the
+ * keyframe times, then lets those pages go again; keyframes are paged
+ * back in as playback reaches them and dropped with release() once it
+ * has moved past them.
+ **/
+class show
+{
+private:
+    int m_fd = -1;
+    void *m_map = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    /**
+     * @throws std::system_error if path can't be opened or mapped.
+     * @throws std::runtime_error if path isn't a compiled timeline.
+     **/
+    explicit show(const std::string &path);
+    ~show(void);
+
+    show(const show &) = delete;
+    show &operator=(const show &) = delete;
+
+    std::size_t size(void) const;
+    uint32_t duration(void) const;
+    bool loops(void) const;
+
+    const keyframe &operator[](std::size_t i) const;
+
+    // Let go of the pages holding keyframes before index i.
+    void release(std::size_t i) const;
+
+private:
+    const header *head(void) const;
+};
+
+// What the show sets at one instant.
+struct frame {
+    std::array<color::rgb, 4> colors;
+    uint32_t level = 0;
+
+    bool operator==(const frame &other) const;
+    bool operator!=(const frame &other) const;
+};
+
+/**
+ * @brief Sample s at ms milliseconds into the show.
+ *
+ * The search for the surrounding keyframes starts at hint, the value
+ * returned for the previous sample, so playing forward costs O(1) per
+ * frame. Times before the first keyframe hold it, as do times past the
+ * last one.
+ *
+ * @returns The index of the keyframe at or before ms.
+ **/
+std::size_t sample(const show &s, uint32_t ms, std::size_t hint,
+                   frame &out);
+
+/**
+ * @brief Plays compiled timelines on a keyboard.
+ *
+ * Frames are paced by a timing::frame_clock and written through the
+ * stage/commit path as one fs::batch per frame, like effects::engine.
+ **/
+class player
+{
+private:
+    color::keyboard &m_kb;
+    led::brightness<uint32_t> &m_brightness;
+    fs::batch &m_batch;
+
+public:
+    player(color::keyboard &kb, led::brightness<uint32_t> &brightness,
+           fs::batch &batch);
+
+    /**
+     * @brief Play s until it ends or SIGINT/SIGTERM.
+     *
+     * A show that plays to its end stays on its last keyframe; looping
+     * shows only end when interrupted. When interrupted, the colors and
+     * level in base are restored.
+     **/
+    effects::stats run(const show &s, const effects::params &base,
+                       unsigned fps);
+
+private:
+    fs::commit_stats commit(void);
+};
+
+}; // namespace timeline
+
+#endif /* TIMELINE_HPP */
@@ -0,0 +1,232 @@
+#include "uring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+using namespace fs;
+
+static int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned submit, unsigned wait)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait,
+                   wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+                             unsigned count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+[[noreturn]] static void fail(int error, const char *what)
+{
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+template <typename T>
+static T *at(void *base, uint32_t offset)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+
+uring::uring(void)
+{
+    std::fill(std::begin(m_files), std::end(m_files), -1);
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = io_uring_setup(entries, &params);
+    if (m_fd == -1)
+        fail(errno, "io_uring_setup");
+
+    try {
+        // IORING_OP_WRITE only exists since Linux 5.6; so does probing.
+        std::vector<char> buf(sizeof(io_uring_probe) +
+                              256 * sizeof(io_uring_probe_op));
+        auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+        int rc = io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256);
+        if (rc == -1)
+            fail(errno, "io_uring_register");
+        if (probe->last_op < IORING_OP_WRITE ||
+            !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED))
+            fail(ENOTSUP, "IORING_OP_WRITE");
+
+        m_sq_ring_size =
+            params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            m_sq_ring_size = m_cq_ring_size =
+                std::max(m_sq_ring_size, m_cq_ring_size);
+
+        m_sq_ring =
+            mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ring == MAP_FAILED) {
+            m_sq_ring = nullptr;
+            fail(errno, "mmap");
+        }
+
+        if (single) {
+            m_cq_ring = m_sq_ring;
+        } else {
+            m_cq_ring =
+                mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (m_cq_ring == MAP_FAILED) {
+                m_cq_ring = nullptr;
+                fail(errno, "mmap");
+            }
+        }
+
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            fail(errno, "mmap");
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+    } catch (...) {
+        teardown();
+        throw;
+    }
+
+    m_sq_tail = at<unsigned>(m_sq_ring, params.sq_off.tail);
+    m_sq_mask = at<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+    m_sq_array = at<unsigned>(m_sq_ring, params.sq_off.array);
+    m_cq_head = at<unsigned>(m_cq_ring, params.cq_off.head);
+    m_cq_tail = at<unsigned>(m_cq_ring, params.cq_off.tail);
+    m_cq_mask = at<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+    m_cqes = at<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+
+    // A sparse table, filled in as descriptors show up. Without it
+    // (kernels before 5.5), writes just use plain descriptors.
+    m_fixed = io_uring_register(m_fd, IORING_REGISTER_FILES, m_files,
+                                max_files) != -1;
+}
+
+uring::~uring(void)
+{
+    teardown();
+}
+
+void uring::submit(write_op *ops, std::size_t count)
+{
+    if (count > entries)
+        fail(EINVAL, "io_uring batch too large");
+
+    unsigned tail = *m_sq_tail;
+    unsigned busy = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        int fixed = slot(ops[i], busy);
+        unsigned index = tail & *m_sq_mask;
+        auto &sqe = m_sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fixed != -1 ? fixed : ops[i].fd;
+        sqe.flags = fixed != -1 ? IOSQE_FIXED_FILE : 0;
+        sqe.addr = reinterpret_cast<uint64_t>(ops[i].buf);
+        sqe.len = ops[i].size;
+        sqe.off = 0;
+        sqe.user_data = i;
+        m_sq_array[index] = index;
+        ops[i].result = -EINPROGRESS;
+        ++tail;
+    }
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+    // Submit and wait in one call; only an interrupted or partial
+    // submission needs another round.
+    unsigned unsubmitted = count;
+    unsigned pending = count;
+    while (pending) {
+        int rc = io_uring_enter(m_fd, unsubmitted, pending);
+        if (rc == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                reap(ops, pending);
+                continue;
+            }
+            fail(errno, "io_uring_enter");
+        }
+        unsubmitted -= std::min<unsigned>(rc, unsubmitted);
+        reap(ops, pending);
+    }
+}
+
+int uring::slot(const write_op &op, unsigned &busy)
+{
+    if (!m_fixed)
+        return -1;
+
+    int free = -1;
+    for (unsigned i = 0; i < max_files; ++i) {
+        if (m_files[i] == op.fd && m_paths[i] == *op.path) {
+            busy |= 1u << i;
+            return i;
+        }
+        if (free == -1 && m_files[i] == -1)
+            free = i;
+    }
+
+    // Full: recycle a slot no earlier write in this batch refers to.
+    // A keyboard only needs five, so this is rare.
+    for (unsigned i = 0; free == -1; ++i) {
+        unsigned candidate = (m_next + i) % max_files;
+        if (!(busy & (1u << candidate)))
+            free = candidate;
+    }
+    m_next = (free + 1) % max_files;
+
+    int fd = op.fd;
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = free;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    int rc = io_uring_register(m_fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+    if (rc != 1)
+        return -1;
+
+    m_files[free] = fd;
+    m_paths[free] = *op.path;
+    busy |= 1u << free;
+    return free;
+}
+
+void uring::reap(write_op *ops, unsigned &pending)
+{
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        auto &cqe = m_cqes[head & *m_cq_mask];
+        ops[cqe.user_data].result = cqe.res;
+        --pending;
+        ++head;
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+}
+
+void uring::teardown(void)
+{
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ring && m_cq_ring != m_sq_ring)
+        munmap(m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring)
+        munmap(m_sq_ring, m_sq_ring_size);
+    if (m_fd != -1)
+        ::close(m_fd);
+
+    m_sqes = nullptr;
+    m_cq_ring = m_sq_ring = nullptr;
+    m_fd = -1;
+}
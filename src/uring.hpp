@@ -0,0 +1,106 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace fs
+{
+
+/**
+ * @brief A minimal io_uring instance for batches of positional writes.
+ *
+ * Talks to the kernel through the raw io_uring_setup(2),
+ * io_uring_enter(2) and io_uring_register(2) syscalls; there is no
+ * liburing dependency. Descriptors are kept in a small registered
+ * (fixed) file table so the kernel doesn't look them up per write.
+ **/
+class uring
+{
+public:
+    // Largest batch submit() takes.
+    static constexpr unsigned entries = 8;
+
+    // One write at offset 0; result receives bytes written or -errno.
+    struct write_op {
+        int fd;
+
+        // Path fd was opened from; tells a reused descriptor number
+        // apart from the file registered under it before.
+        const std::string *path;
+
+        const char *buf;
+        uint32_t size;
+        int32_t result;
+    };
+
+private:
+    static constexpr unsigned max_files = 16;
+
+    int m_fd = -1;
+
+    void *m_sq_ring = nullptr;
+    void *m_cq_ring = nullptr;
+    std::size_t m_sq_ring_size = 0;
+    std::size_t m_cq_ring_size = 0;
+
+    ::io_uring_sqe *m_sqes = nullptr;
+    std::size_t m_sqes_size = 0;
+
+    unsigned *m_sq_tail = nullptr;
+    unsigned *m_sq_mask = nullptr;
+    unsigned *m_sq_array = nullptr;
+    unsigned *m_cq_head = nullptr;
+    unsigned *m_cq_tail = nullptr;
+    unsigned *m_cq_mask = nullptr;
+    ::io_uring_cqe *m_cqes = nullptr;
+
+    // Registered descriptors by slot, or -1; empty if registration
+    // isn't supported, in which case plain descriptors are used.
+    bool m_fixed = false;
+    int m_files[max_files];
+    std::string m_paths[max_files];
+    unsigned m_next = 0;
+
+public:
+    /**
+     * @brief Set up a ring.
+     *
+     * @throws std::system_error if io_uring is unavailable (old kernel,
+     *         disabled by sysctl or seccomp) or lacks IORING_OP_WRITE.
+     **/
+    uring(void);
+    ~uring(void);
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    /**
+     * @brief Submit ops as one batch and wait for all of them.
+     *
+     * Costs a single io_uring_enter(2) in the common case.
+     *
+     * @param ops Writes to perform; at most entries of them.
+     * @param count Number of ops.
+     * @throws std::system_error if the batch couldn't be submitted;
+     *         failures of individual writes land in their result.
+     **/
+    void submit(write_op *ops, std::size_t count);
+
+private:
+    // Fixed file slot for op's file, registering it if needed; -1 if
+    // the plain descriptor has to be used. busy holds the slots the
+    // batch being built already refers to.
+    int slot(const write_op &op, unsigned &busy);
+
+    void reap(write_op *ops, unsigned &pending);
+    void teardown(void);
+};
+
+}; // namespace fs
+
+#endif /* URING_HPP */
@@ -0,0 +1,107 @@
+#include "watcher.hpp"
+#include <cerrno>
+#include <charconv>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace led;
+
+hw_watcher::hw_watcher(const std::string &dir)
+    : m_node(dir + HW_BRIGHTNESS_FILE)
+{
+    consume();
+}
+
+int hw_watcher::fd(void)
+{
+    return m_node.fd();
+}
+
+std::optional<uint32_t> hw_watcher::wait(void)
+{
+    pollfd p{m_node.fd(), POLLPRI | POLLERR, 0};
+    while (poll(&p, 1, -1) > 0) {
+        if (auto level = consume())
+            return level;
+    }
+    return std::nullopt;
+}
+
+std::optional<uint32_t> hw_watcher::consume(void)
+{
+    char buf[32];
+    auto n = m_node.read(buf, sizeof(buf));
+
+    uint32_t level;
+    auto [ptr, ec] = std::from_chars(buf, buf + n, level);
+    if (ec != std::errc() || level == m_level)
+        return std::nullopt;
+
+    m_level = level;
+    return level;
+}
+
+uint32_t hw_watcher::level(void) const
+{
+    return m_level;
+}
+
+change_watcher::change_watcher(const std::string &cache_dir)
+{
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify == -1)
+        throw std::system_error(errno, std::generic_category(),
+                                "inotify_init1");
+
+    // State files are replaced with rename(), or written in place by
+    // older versions.
+    if (inotify_add_watch(m_inotify, cache_dir.c_str(),
+                          IN_MOVED_TO | IN_CLOSE_WRITE) == -1) {
+        int error = errno;
+        close(m_inotify);
+        throw std::system_error(error, std::generic_category(), cache_dir);
+    }
+}
+
+change_watcher::~change_watcher(void)
+{
+    close(m_inotify);
+}
+
+void change_watcher::add(const std::string &path, bool notified)
+{
+    if (inotify_add_watch(m_inotify, path.c_str(), IN_MODIFY) == -1)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    if (notified) {
+        // Reading the attribute arms POLLPRI.
+        fs::node node(path);
+        char buf[32];
+        node.read(buf, sizeof(buf));
+        m_notified.push_back(std::move(node));
+    }
+}
+
+bool change_watcher::wait(void)
+{
+    std::vector<pollfd> fds;
+    fds.push_back({m_inotify, POLLIN, 0});
+    for (auto &node : m_notified)
+        fds.push_back({node.fd(), POLLPRI | POLLERR, 0});
+
+    if (poll(fds.data(), fds.size(), -1) == -1)
+        return false;
+
+    alignas(inotify_event) char buf[4096];
+    while (read(m_inotify, buf, sizeof(buf)) > 0)
+        ;
+
+    char value[32];
+    for (std::size_t i = 1; i < fds.size(); ++i) {
+        if (fds[i].revents)
+            m_notified[i - 1].read(value, sizeof(value));
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+#include "brightness.hpp"
+#include "fs.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace led
+{
+
+/**
+ * @brief Event-driven tracking of brightness_hw_changed.
+ *
+ * The kernel calls sysfs_notify() on brightness_hw_changed whenever the
+ * firmware changes the level (the Fn keys), which wakes poll(2) waiters
+ * with POLLPRI | POLLERR. Reading the attribute re-arms it. There is no
+ * timeout and no periodic wakeup: an idle watcher costs nothing.
+ **/
+class hw_watcher
+{
+private:
+    fs::node m_node;
+    uint32_t m_level = 0;
+
+public:
+    /**
+     * @brief Arm the watcher by reading the attribute once.
+     *
+     * @param dir Attribute directory of the LED to watch.
+     * @throws std::system_error if brightness_hw_changed is unavailable.
+     **/
+    explicit hw_watcher(const std::string &dir = SYSFS_PREFIX);
+
+    // Descriptor to poll for POLLPRI, for callers with their own loop.
+    int fd(void);
+
+    /**
+     * @brief Block until the firmware changes the level.
+     *
+     * @returns The new level, or std::nullopt if poll() was interrupted
+     *          by a signal.
+     **/
+    std::optional<uint32_t> wait(void);
+
+    /**
+     * @brief Read and re-arm after poll() reported an event on fd().
+     *
+     * @returns The new level, or std::nullopt if it didn't change.
+     **/
+    std::optional<uint32_t> consume(void);
+
+    // Last level read from the attribute.
+    uint32_t level(void) const;
+};
+
+/**
+ * @brief Wakes up when a keyboard's attributes or caches may have
+ *        changed.
+ *
+ * Attributes are watched with inotify, which reports every write(2) to
+ * them no matter who makes it, and the cache directory with inotify
+ * too, for state files being replaced. Attributes the kernel signals
+ * itself with sysfs_notify(), like brightness_hw_changed, are polled
+ * for POLLPRI on top. Nothing is ever polled on a timer, so waiting
+ * costs nothing while the keyboard is left alone.
+ **/
+class change_watcher
+{
+private:
+    int m_inotify = -1;
+    std::vector<fs::node> m_notified;
+
+public:
+    /**
+     * @brief Watch the state files in cache_dir.
+     *
+     * @throws std::system_error if inotify is unavailable.
+     **/
+    explicit change_watcher(const std::string &cache_dir);
+    ~change_watcher(void);
+
+    change_watcher(const change_watcher &) = delete;
+    change_watcher &operator=(const change_watcher &) = delete;
+
+    /**
+     * @brief Also wake up on writes to the attribute at path.
+     *
+     * @param notified Whether the kernel sysfs_notify()s the attribute.
+     * @throws std::system_error if path can't be watched.
+     **/
+    void add(const std::string &path, bool notified = false);
+
+    /**
+     * @brief Block until anything watched changes.
+     *
+     * Every event already queued is consumed, so a burst of writes
+     * wakes the caller once.
+     *
+     * @returns false if the wait was interrupted by a signal.
+     **/
+    bool wait(void);
+};
+
+}; // namespace led
+
+#endif /* WATCHER_HPP */